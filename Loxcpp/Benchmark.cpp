@@ -0,0 +1,109 @@
+#include "Benchmark.h"
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "HashTable.h"
+#include "Object.h"
+
+// Nanoseconds per operation of running op over all keys
+template<class Op>
+static double measure(const std::vector<ObjString*>& keys, Op&& op)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (ObjString* key : keys)
+    {
+        op(key);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / keys.size();
+}
+
+// Slowest single insertion in microseconds, where resizing shows up
+template<class TableType>
+static double worstInsert(const std::vector<ObjString*>& keys)
+{
+    TableType table;
+    double worst = 0.0;
+    for (ObjString* key : keys)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        table.set(key, Value(1.0));
+        const auto end = std::chrono::steady_clock::now();
+        worst = std::max(worst, std::chrono::duration<double, std::micro>(end - start).count());
+    }
+    return worst;
+}
+
+template<class TableType>
+static void benchmarkTable(const char* name, const std::vector<ObjString*>& keys, const std::vector<ObjString*>& missing)
+{
+    TableType table;
+    size_t found = 0;
+
+    const double insert = measure(keys, [&](ObjString* key) { table.set(key, Value(1.0)); });
+    const double hit = measure(keys, [&](ObjString* key) { Value value; found += table.get(key, &value); });
+    const double miss = measure(missing, [&](ObjString* key) { Value value; found += table.get(key, &value); });
+    const double intern = measure(keys, [&](ObjString* key) { found += table.findString(key->chars(), key->length, key->hash) != nullptr; });
+    const double remove = measure(keys, [&](ObjString* key) { found += table.remove(key); });
+    const double worst = worstInsert<TableType>(keys);
+
+    std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(1)
+        << std::setw(10) << insert
+        << std::setw(10) << hit
+        << std::setw(10) << miss
+        << std::setw(10) << intern
+        << std::setw(10) << remove
+        << std::setw(12) << worst
+        << "    (" << found << " found)" << std::endl;
+}
+
+static std::vector<ObjString*> makeKeys(const char* prefix, size_t count)
+{
+    // Keys are created outside of the VM, so the garbage collector doesn't know about them
+    std::vector<ObjString*> keys;
+    keys.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const std::string chars = prefix + std::to_string(i);
+        const int length = static_cast<int>(chars.length());
+        ObjString* key = new (length) ObjString(chars.c_str(), length);
+        key->hash = hashString(chars.c_str(), length);
+        keys.push_back(key);
+    }
+
+    // Visit the keys in random order, sequential names would otherwise land in neighbouring slots
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(1234));
+    return keys;
+}
+
+void benchmarkTables()
+{
+    for (const size_t count : { 1000, 100000, 1000000 })
+    {
+        const std::vector<ObjString*> keys = makeKeys("key", count);
+        const std::vector<ObjString*> missing = makeKeys("missing", count);
+
+        std::cout << count << " keys, ns per operation and slowest insertion" << std::endl;
+        std::cout << std::left << std::setw(12) << "" << std::right
+            << std::setw(10) << "insert"
+            << std::setw(10) << "hit"
+            << std::setw(10) << "miss"
+            << std::setw(10) << "intern"
+            << std::setw(10) << "remove"
+            << std::setw(12) << "worst (us)" << std::endl;
+
+        benchmarkTable<TableLox>("TableLox", keys, missing);
+        benchmarkTable<TableCpp>("TableCpp", keys, missing);
+        benchmarkTable<TableSwiss>("TableSwiss", keys, missing);
+        std::cout << std::endl;
+
+        for (ObjString* key : keys) delete key;
+        for (ObjString* key : missing) delete key;
+    }
+}
@@ -0,0 +1,7 @@
+#ifndef loxcpp_benchmark_h
+#define loxcpp_benchmark_h
+
+// Compares the string keyed tables (TableLox, TableCpp and TableSwiss) on insertions, lookups and removals
+void benchmarkTables();
+
+#endif
@@ -0,0 +1,156 @@
+#include "Bytes.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "File.h"
+#include "Object.h"
+
+bool parsePackFormat(std::string_view text, PackFormat* format)
+{
+    if (text.length() < 2) return false;
+
+    const char kind = text[0];
+    if (kind != 'u' && kind != 'i' && kind != 'f') return false;
+    text.remove_prefix(1);
+
+    format->bigEndian = false;
+    if (text.length() > 2 && (text.substr(text.length() - 2) == "le" || text.substr(text.length() - 2) == "be"))
+    {
+        format->bigEndian = text.substr(text.length() - 2) == "be";
+        text.remove_suffix(2);
+    }
+
+    if (text == "8") format->size = 1;
+    else if (text == "16") format->size = 2;
+    else if (text == "32") format->size = 4;
+    else if (text == "64") format->size = 8;
+    else return false;
+
+    format->kind = kind;
+    return kind != 'f' || format->size >= 4;
+}
+
+static void storeBits(uint8_t* destination, uint64_t bits, int size, bool bigEndian)
+{
+    for (int i = 0; i < size; ++i)
+    {
+        const int shift = 8 * (bigEndian ? size - 1 - i : i);
+        destination[i] = static_cast<uint8_t>(bits >> shift);
+    }
+}
+
+static uint64_t loadBits(const uint8_t* source, int size, bool bigEndian)
+{
+    uint64_t bits = 0;
+    for (int i = 0; i < size; ++i)
+    {
+        const int shift = 8 * (bigEndian ? size - 1 - i : i);
+        bits |= static_cast<uint64_t>(source[i]) << shift;
+    }
+    return bits;
+}
+
+bool packNumber(uint8_t* destination, const PackFormat& format, double value)
+{
+    uint64_t bits;
+    if (format.kind == 'f')
+    {
+        if (format.size == 4)
+        {
+            const float single = static_cast<float>(value);
+            uint32_t singleBits;
+            memcpy(&singleBits, &single, sizeof(singleBits));
+            bits = singleBits;
+        }
+        else
+        {
+            memcpy(&bits, &value, sizeof(bits));
+        }
+    }
+    else
+    {
+        if (std::trunc(value) != value) return false;
+
+        // Limits as doubles: 2^(bits - 1) for signed and 2^bits for unsigned, both exact
+        const int width = format.size * 8;
+        if (format.kind == 'u')
+        {
+            if (value < 0.0 || value >= std::ldexp(1.0, width)) return false;
+            bits = static_cast<uint64_t>(value);
+        }
+        else
+        {
+            const double limit = std::ldexp(1.0, width - 1);
+            if (value < -limit || value >= limit) return false;
+            bits = static_cast<uint64_t>(static_cast<int64_t>(value));
+        }
+    }
+
+    storeBits(destination, bits, format.size, format.bigEndian);
+    return true;
+}
+
+double unpackNumber(const uint8_t* source, const PackFormat& format)
+{
+    const uint64_t bits = loadBits(source, format.size, format.bigEndian);
+
+    if (format.kind == 'f')
+    {
+        if (format.size == 4)
+        {
+            const uint32_t singleBits = static_cast<uint32_t>(bits);
+            float single;
+            memcpy(&single, &singleBits, sizeof(single));
+            return single;
+        }
+
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    if (format.kind == 'u' || format.size == 8)
+        return format.kind == 'u' ? static_cast<double>(bits) : static_cast<double>(static_cast<int64_t>(bits));
+
+    // Sign extension of the narrower integers
+    const int unused = 64 - format.size * 8;
+    return static_cast<double>(static_cast<int64_t>(bits << unused) >> unused);
+}
+
+ObjBytes* readBytesFile(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) return nullptr;
+
+    // The size is only known when the file is seekable, pipes and the like are read in chunks
+    std::vector<uint8_t> content;
+    if (fseek(file, 0, SEEK_END) == 0)
+    {
+        const long size = ftell(file);
+        if (size > 0) content.reserve(static_cast<size_t>(size));
+        fseek(file, 0, SEEK_SET);
+    }
+
+    uint8_t chunk[65536];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    {
+        content.insert(content.end(), chunk, chunk + read);
+    }
+
+    const bool failed = ferror(file) != 0;
+    fclose(file);
+    if (failed) return nullptr;
+
+    ObjBytes* bytes = newBytes(0);
+    bytes->storage = std::move(content);
+    bytes->length = bytes->storage.size();
+    return bytes;
+}
+
+bool writeBytesFile(const char* path, ObjBytes* bytes)
+{
+    return writeWholeFile(path, reinterpret_cast<const char*>(bytes->data()), bytes->length);
+}
@@ -0,0 +1,32 @@
+#ifndef loxcpp_bytes_h
+#define loxcpp_bytes_h
+
+#include <cstdint>
+#include <string_view>
+
+struct ObjBytes;
+
+// Layout of a number in a byte buffer, written like "u8", "i32le", "u16be" or "f64le".
+// Integers are u (unsigned) or i (signed) with 8, 16, 32 or 64 bits, floats are f with 32 or 64 bits.
+// Without "le" or "be" they are little endian.
+struct PackFormat
+{
+    char kind;      // 'u', 'i' or 'f'
+    int size;       // In bytes
+    bool bigEndian;
+};
+
+bool parsePackFormat(std::string_view text, PackFormat* format);
+
+// Returns false if the number doesn't fit the format: integers have to be whole and in range
+bool packNumber(uint8_t* destination, const PackFormat& format, double value);
+
+// 64 bit integers above 2^53 lose precision, like any other number
+double unpackNumber(const uint8_t* source, const PackFormat& format);
+
+// Reads a whole file into a new buffer, nullptr if the file can't be read
+ObjBytes* readBytesFile(const char* path);
+
+bool writeBytesFile(const char* path, ObjBytes* bytes);
+
+#endif
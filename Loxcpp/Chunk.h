@@ -42,10 +42,15 @@ enum class OpCode : uint8_t
     OP_MODULO,
     OP_INCREMENT,
     OP_BUILD_RANGE,
+    OP_BUILD_RANGE_STEP,
     OP_BUILD_LIST,
+    OP_BUILD_MAP,
+    OP_BUILD_STRING,
     OP_INDEX_SUBSCR,
     OP_STORE_SUBSCR,
     OP_RANGE_IN_BOUNDS,
+    OP_RANGE_VALUE,
+    OP_RANGE_SETUP,
     OP_NOT,
     OP_PRINT,
     OP_JUMP,
@@ -66,6 +71,74 @@ enum class OpCode : uint8_t
     COUNT
 };
 
+inline const char* opCodeToString(const OpCode opCode)
+{
+    switch (opCode)
+    {
+    case OpCode::OP_CONSTANT: return "OP_CONSTANT";
+    case OpCode::OP_CONSTANT_LONG: return "OP_CONSTANT_LONG";
+    case OpCode::OP_NIL: return "OP_NIL";
+    case OpCode::OP_TRUE: return "OP_TRUE";
+    case OpCode::OP_FALSE: return "OP_FALSE";
+    case OpCode::OP_POP: return "OP_POP";
+    case OpCode::OP_GET_LOCAL: return "OP_GET_LOCAL";
+    case OpCode::OP_SET_LOCAL: return "OP_SET_LOCAL";
+    case OpCode::OP_GET_LOCAL_LONG: return "OP_GET_LOCAL_LONG";
+    case OpCode::OP_SET_LOCAL_LONG: return "OP_SET_LOCAL_LONG";
+    case OpCode::OP_GET_GLOBAL: return "OP_GET_GLOBAL";
+    case OpCode::OP_DEFINE_GLOBAL: return "OP_DEFINE_GLOBAL";
+    case OpCode::OP_SET_GLOBAL: return "OP_SET_GLOBAL";
+    case OpCode::OP_GET_GLOBAL_LONG: return "OP_GET_GLOBAL_LONG";
+    case OpCode::OP_DEFINE_GLOBAL_LONG: return "OP_DEFINE_GLOBAL_LONG";
+    case OpCode::OP_SET_GLOBAL_LONG: return "OP_SET_GLOBAL_LONG";
+    case OpCode::OP_GET_UPVALUE: return "OP_GET_UPVALUE";
+    case OpCode::OP_SET_UPVALUE: return "OP_SET_UPVALUE";
+    case OpCode::OP_SET_PROPERTY: return "OP_SET_PROPERTY";
+    case OpCode::OP_SET_PROPERTY_LONG: return "OP_SET_PROPERTY_LONG";
+    case OpCode::OP_GET_PROPERTY: return "OP_GET_PROPERTY";
+    case OpCode::OP_GET_PROPERTY_LONG: return "OP_GET_PROPERTY_LONG";
+    case OpCode::OP_EQUAL: return "OP_EQUAL";
+    case OpCode::OP_MATCH: return "OP_MATCH";
+    case OpCode::OP_GREATER: return "OP_GREATER";
+    case OpCode::OP_LESS: return "OP_LESS";
+    case OpCode::OP_NEGATE: return "OP_NEGATE";
+    case OpCode::OP_ADD: return "OP_ADD";
+    case OpCode::OP_SUBTRACT: return "OP_SUBTRACT";
+    case OpCode::OP_MULTIPLY: return "OP_MULTIPLY";
+    case OpCode::OP_DIVIDE: return "OP_DIVIDE";
+    case OpCode::OP_MODULO: return "OP_MODULO";
+    case OpCode::OP_INCREMENT: return "OP_INCREMENT";
+    case OpCode::OP_BUILD_RANGE: return "OP_BUILD_RANGE";
+    case OpCode::OP_BUILD_RANGE_STEP: return "OP_BUILD_RANGE_STEP";
+    case OpCode::OP_BUILD_LIST: return "OP_BUILD_LIST";
+    case OpCode::OP_BUILD_MAP: return "OP_BUILD_MAP";
+    case OpCode::OP_BUILD_STRING: return "OP_BUILD_STRING";
+    case OpCode::OP_INDEX_SUBSCR: return "OP_INDEX_SUBSCR";
+    case OpCode::OP_STORE_SUBSCR: return "OP_STORE_SUBSCR";
+    case OpCode::OP_RANGE_IN_BOUNDS: return "OP_RANGE_IN_BOUNDS";
+    case OpCode::OP_RANGE_VALUE: return "OP_RANGE_VALUE";
+    case OpCode::OP_RANGE_SETUP: return "OP_RANGE_SETUP";
+    case OpCode::OP_NOT: return "OP_NOT";
+    case OpCode::OP_PRINT: return "OP_PRINT";
+    case OpCode::OP_JUMP: return "OP_JUMP";
+    case OpCode::OP_JUMP_IF_FALSE: return "OP_JUMP_IF_FALSE";
+    case OpCode::OP_LOOP: return "OP_LOOP";
+    case OpCode::OP_CALL: return "OP_CALL";
+    case OpCode::OP_INVOKE: return "OP_INVOKE";
+    case OpCode::OP_INVOKE_LONG: return "OP_INVOKE_LONG";
+    case OpCode::OP_CLOSURE: return "OP_CLOSURE";
+    case OpCode::OP_CLOSURE_LONG: return "OP_CLOSURE_LONG";
+    case OpCode::OP_CLOSE_UPVALUE: return "OP_CLOSE_UPVALUE";
+    case OpCode::OP_RETURN: return "OP_RETURN";
+    case OpCode::OP_CLASS: return "OP_CLASS";
+    case OpCode::OP_CLASS_LONG: return "OP_CLASS_LONG";
+    case OpCode::OP_METHOD: return "OP_METHOD";
+    case OpCode::OP_METHOD_LONG: return "OP_METHOD_LONG";
+    }
+    return "UNKNOWN";
+    static_assert(static_cast<int>(OpCode::COUNT) == 59, "Missing enum value");
+}
+
 typedef std::vector<uint8_t> ChunkInstructions;
 
 struct Chunk
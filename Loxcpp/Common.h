@@ -6,6 +6,7 @@
 //#define DEBUG_OBJECT_LIFETIME
 //#define DEBUG_STRESS_GC
 //#define DEBUG_LOG_GC
+//#define DEBUG_OPCODE_STATS
 
 //#define FORCE_LONG_OPS
 
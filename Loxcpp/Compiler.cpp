@@ -332,7 +332,7 @@ ObjFunction* Compiler::endCompiler()
         if (!parser.hadError)
         {
             disassembleChunk(*currentChunk(), function->name != nullptr
-                ? function->name->chars.c_str() : "<script>");
+                ? function->name->chars() : "<script>");
         }
     #endif
     
@@ -359,7 +359,6 @@ void Compiler::binary(bool canAssign)
         case TokenType::STAR:          emitByte(OpByte(OpCode::OP_MULTIPLY)); break;
         case TokenType::SLASH:         emitByte(OpByte(OpCode::OP_DIVIDE)); break;
         case TokenType::PERCENTAGE:    emitByte(OpByte(OpCode::OP_MODULO)); break;
-        case TokenType::DOT_DOT:       emitByte(OpByte(OpCode::OP_BUILD_RANGE)); break;
         default: return; // Unreachable.
     }
 }
@@ -451,6 +450,39 @@ void Compiler::string(bool canAssign)
     emitConstant(Value(copyString(parser.previous.start + 1, parser.previous.length - 2)));
 }
 
+void Compiler::interpolation(bool canAssign)
+{
+    // Pieces of text and expressions are pushed in order, then built into a single string
+    int partCount = 0;
+    do
+    {
+        // Skip the " or } before the piece and the ${ after it
+        if (parser.previous.length > 3)
+        {
+            emitConstant(Value(copyString(parser.previous.start + 1, parser.previous.length - 3)));
+            partCount++;
+        }
+
+        expression();
+        partCount++;
+    } while (match(TokenType::INTERPOLATION));
+
+    consume(TokenType::STRING, "Expect end of string interpolation.");
+    if (parser.previous.length > 2)
+    {
+        emitConstant(Value(copyString(parser.previous.start + 1, parser.previous.length - 2)));
+        partCount++;
+    }
+
+    if (partCount > UINT8_MAX)
+    {
+        error("Cannot have more than 255 parts in an interpolated string.");
+    }
+
+    emitByte(OpByte(OpCode::OP_BUILD_STRING));
+    emitByte(partCount);
+}
+
 void Compiler::namedVariable(const Token& name, bool canAssign)
 {
     OpCode getOp;
@@ -581,6 +613,70 @@ inline void Compiler::list(bool canAssign)
     return;
 }
 
+void Compiler::map(bool canAssign)
+{
+    int entryCount = 0;
+    if (!check(TokenType::RIGHT_BRACE))
+    {
+        do {
+            if (check(TokenType::RIGHT_BRACE))
+            {
+                // Trailing comma case
+                break;
+            }
+
+            parsePrecedence(Precedence::OR);
+            consume(TokenType::COLON, "Expect ':' after map key.");
+            parsePrecedence(Precedence::OR);
+
+            if (entryCount == UINT8_COUNT) {
+                error("Cannot have more than 256 entries in a map literal.");
+            }
+            entryCount++;
+        } while (match(TokenType::COMMA));
+    }
+
+    consume(TokenType::RIGHT_BRACE, "Expect '}' after map literal.");
+
+    emitByte(OpByte(OpCode::OP_BUILD_MAP));
+    emitByte(entryCount);
+}
+
+void Compiler::rangeUpperBound()
+{
+    // Open ranges (5..) have no upper bound, a brace after the range opens a block, not a map
+    if (getRule(parser.current.type)->prefix == nullptr || check(TokenType::LEFT_BRACE))
+    {
+        emitConstant(Value(HUGE_VAL));
+    }
+    else
+    {
+        parsePrecedence(nextPrecedence(Precedence::RANGE));
+    }
+}
+
+void Compiler::range(bool canAssign)
+{
+    rangeUpperBound();
+
+    if (match(TokenType::STEP))
+    {
+        parsePrecedence(nextPrecedence(Precedence::RANGE));
+        emitByte(OpByte(OpCode::OP_BUILD_RANGE_STEP));
+    }
+    else
+    {
+        emitByte(OpByte(OpCode::OP_BUILD_RANGE));
+    }
+}
+
+void Compiler::openRange(bool canAssign)
+{
+    // Ranges without lower bound (..6)
+    emitConstant(Value(-HUGE_VAL));
+    range(canAssign);
+}
+
 void Compiler::parsePrecedence(Precedence precedence)
 {
     advance();
@@ -594,6 +690,11 @@ void Compiler::parsePrecedence(Precedence precedence)
     const bool canAssign = precedence <= Precedence::ASSIGNMENT;
     (this->*prefixRule)(canAssign);
 
+    parseInfix(precedence, canAssign);
+}
+
+void Compiler::parseInfix(Precedence precedence, bool canAssign)
+{
     while (precedence <= getRule(parser.current.type)->precedence)
     {
         advance();
@@ -1051,10 +1152,23 @@ void Compiler::forInStatement()
 
     consume(TokenType::IN, "Expect 'in' after loop variable.");
 
+    if (check(TokenType::DOT_DOT))
+    {
+        errorAtCurrent("Can't iterate a range without a start.");
+    }
+
+    // Parse the first operand on its own, range literals get a loop that doesn't allocate the range
+    parsePrecedence(nextPrecedence(Precedence::RANGE));
+    if (match(TokenType::DOT_DOT))
+    {
+        forInRange(localVarToken, iterToken);
+        return;
+    }
+    parseInfix(Precedence::ASSIGNMENT, false); // This should resolve to an iterable
+
     // Initialize our hidden local range var
     const Token rangeToken(TokenType::VAR, "__range", 7, parser.current.line);
     addLocal(rangeToken, false);
-    expression(); // This should resolve to a range or a string
     emitVariable(rangeToken, true); // Set the range value
 
     const size_t loopStart = currentChunk()->code.size();
@@ -1077,7 +1191,7 @@ void Compiler::forInStatement()
     namedVariable(iterToken, false); // Load iterator
 
     // Set the local variable value before running the statement
-    emitByte(OpByte(OpCode::OP_INDEX_SUBSCR));
+    emitByte(OpByte(OpCode::OP_RANGE_VALUE));
     emitVariable(localVarToken, true, true); // Set local variable
 
     statement();
@@ -1100,6 +1214,91 @@ void Compiler::forInStatement()
     endScope();
 }
 
+void Compiler::forInRange(const Token& localVarToken, const Token& iterToken)
+{
+    /*
+    for i in start..end step s
+        print i;
+
+    is compiled as:
+
+    {
+        var __iter = 0;
+        var __start = start;
+        var __step = s; // Signed, negative when start > end
+        var __count = number of values in the range;
+
+        while (__iter < __count)
+        {
+            const i = __start + __iter * __step;
+            print i;
+            __iter = __iter + 1;
+        }
+    }
+    */
+
+    // The first operand is already on the stack
+    const Token startToken(TokenType::VAR, "__start", 7, parser.current.line);
+    addLocal(startToken, false);
+
+    rangeUpperBound();
+
+    if (match(TokenType::STEP))
+    {
+        parsePrecedence(nextPrecedence(Precedence::RANGE));
+    }
+    else
+    {
+        emitConstant(Value(1.0));
+    }
+
+    // Turns [start, end, step] into [start, signedStep, count]
+    emitByte(OpByte(OpCode::OP_RANGE_SETUP));
+    const Token stepToken(TokenType::VAR, "__step", 6, parser.current.line);
+    addLocal(stepToken, false);
+    const Token countToken(TokenType::VAR, "__count", 7, parser.current.line);
+    addLocal(countToken, false);
+
+    const size_t loopStart = currentChunk()->code.size();
+
+    // Condition
+    namedVariable(iterToken, false);
+    namedVariable(countToken, false);
+    emitByte(OpByte(OpCode::OP_LESS));
+
+    const size_t exitJump = emitJump(OpByte(OpCode::OP_JUMP_IF_FALSE));
+    emitByte(OpByte(OpCode::OP_POP));
+
+    beginScope();
+
+    addLocal(localVarToken, true);
+
+    // Compute the value from the iterator, instead of accumulating the step, so float steps don't drift
+    namedVariable(startToken, false);
+    namedVariable(iterToken, false);
+    namedVariable(stepToken, false);
+    emitByte(OpByte(OpCode::OP_MULTIPLY));
+    emitByte(OpByte(OpCode::OP_ADD));
+    emitVariable(localVarToken, true, true); // Set local variable
+
+    statement();
+
+    endScope();
+
+    // Increment iterator
+    namedVariable(iterToken, false);
+    emitByte(OpByte(OpCode::OP_INCREMENT));
+    emitVariable(iterToken, true);
+    emitByte(OpByte(OpCode::OP_POP));
+
+    emitLoop(loopStart);
+
+    patchJump(exitJump);
+    emitByte(OpByte(OpCode::OP_POP));
+
+    endScope();
+}
+
 void Compiler::ifStatement()
 {
     consume(TokenType::LEFT_PAREN, "Expect '(' after 'if'.");
@@ -17,10 +17,10 @@ enum class Precedence : uint8_t
     AND,         // and
     EQUALITY,    // == !=
     COMPARISON,  // < > <= >=
+    RANGE,       // ..
     TERM,        // + -
     FACTOR,      // * /
     UNARY,       // ! -
-    RANGE,       // ..
     CALL,        // . ()
     SUBSCRIPT,   //  []
     PRIMARY
@@ -95,7 +95,7 @@ class Compiler
     {
       ParseRule(&Compiler::grouping,  &Compiler::call,     Precedence::CALL),        // LEFT_PAREN    
       ParseRule(nullptr,              nullptr,             Precedence::NONE),        // RIGHT_PAREN   
-      ParseRule(nullptr,              nullptr,             Precedence::NONE),        // LEFT_BRACE    
+      ParseRule(&Compiler::map,       nullptr,             Precedence::NONE),        // LEFT_BRACE    
       ParseRule(nullptr,              nullptr,             Precedence::NONE),        // RIGHT_BRACE   
       ParseRule(&Compiler::list,      &Compiler::subscript,Precedence::SUBSCRIPT), // LEFT_BRACKET  
       ParseRule(nullptr,              nullptr,             Precedence::NONE),        // RIGHT_BRACKET 
@@ -117,17 +117,18 @@ class Compiler
       ParseRule(nullptr,              &Compiler::binary,   Precedence::COMPARISON),  // LESS_EQUAL    
       ParseRule(nullptr,              nullptr,             Precedence::NONE),        // PLUS_PLUS     
       ParseRule(nullptr,              nullptr,             Precedence::NONE),        // MINUS_MINUS   // TODO
-      ParseRule(nullptr,              &Compiler::binary,   Precedence::RANGE),       // DOT_DOT       // TODO
+      ParseRule(&Compiler::openRange, &Compiler::range,    Precedence::RANGE),       // DOT_DOT       
       ParseRule(nullptr,              &Compiler::binary,   Precedence::FACTOR),      // PERCENTAGE    // TODO
       ParseRule(&Compiler::variable,  nullptr,             Precedence::NONE),        // IDENTIFIER    // TODO
       ParseRule(&Compiler::string,    nullptr,             Precedence::NONE),        // STRING        
+      ParseRule(&Compiler::interpolation, nullptr,         Precedence::NONE),        // INTERPOLATION 
       ParseRule(&Compiler::number,    nullptr,             Precedence::NONE),        // NUMBER        
       ParseRule(nullptr,              &Compiler::and_,     Precedence::AND),         // AND           
       ParseRule(nullptr,              nullptr,             Precedence::NONE),        // CLASS         
       ParseRule(nullptr,              nullptr,             Precedence::NONE),        // ELSE          
       ParseRule(&Compiler::literal,   nullptr,             Precedence::NONE),        // FALSE         
       ParseRule(&Compiler::funExpr,   nullptr,             Precedence::NONE),        // FUN           
-      ParseRule(nullptr,              nullptr,             Precedence::RANGE),       // FOR           
+      ParseRule(nullptr,              nullptr,             Precedence::NONE),        // FOR           
       ParseRule(nullptr,              nullptr,             Precedence::NONE),        // IF            
       ParseRule(&Compiler::literal,   nullptr,             Precedence::NONE),        // NIL           
       ParseRule(nullptr,              &Compiler::or_,      Precedence::OR),          // OR            
@@ -144,6 +145,7 @@ class Compiler
       ParseRule(nullptr,              nullptr,             Precedence::NONE),        // BREAK         
       ParseRule(nullptr,              nullptr,             Precedence::NONE),        // CONTINUE      
       ParseRule(nullptr,              nullptr,             Precedence::NONE),        // IN            
+      ParseRule(nullptr,              nullptr,             Precedence::NONE),        // STEP          
       ParseRule(nullptr,              nullptr,             Precedence::NONE),        // ERROR         
       ParseRule(nullptr,              nullptr,             Precedence::NONE),        // EOFILE        
     };
@@ -183,13 +185,19 @@ public:
     void number(bool canAssign);
     void or_(bool canAssign);
     void string(bool canAssign);
+    void interpolation(bool canAssign);
     void namedVariable(const Token& name, bool canAssign);
     void variable(bool canAssign);
     void this_(bool canAssign);
     void unary(bool canAssign);
     void funExpr(bool canAssign);
     void list(bool canAssign);
+    void map(bool canAssign);
+    void range(bool canAssign);
+    void rangeUpperBound();
+    void openRange(bool canAssign);
     void parsePrecedence(Precedence precedence);
+    void parseInfix(Precedence precedence, bool canAssign);
     uint32_t identifierConstant(const Token& name);
     bool identifiersEqual(const Token& a, const Token& b);
     int resolveLocal(const CompilerScope& compilerScope, const Token& name);
@@ -218,6 +226,7 @@ public:
     void expressionStatement();
     void forStatement();
     void forInStatement();
+    void forInRange(const Token& localVarToken, const Token& iterToken);
     void ifStatement();
     void printStatement();
     void returnStatement();
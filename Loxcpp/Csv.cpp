@@ -0,0 +1,319 @@
+#include "Csv.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "Object.h"
+#include "Vm.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CSV_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Rows looked at to decide the type of every column
+#define CSV_SAMPLE_ROWS 1000
+
+static inline int lowestBit(uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// Finds the end of an unquoted field: the delimiter or a line break, 16 bytes at a time
+static const char* findFieldEnd(const char* current, const char* end, char delimiter)
+{
+#ifdef CSV_SSE2
+    const __m128i separator = _mm_set1_epi8(delimiter);
+    const __m128i newLine = _mm_set1_epi8('\n');
+    const __m128i carriageReturn = _mm_set1_epi8('\r');
+    for (; current + 16 <= end; current += 16)
+    {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current));
+        const __m128i found = _mm_or_si128(_mm_cmpeq_epi8(chunk, separator),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, newLine), _mm_cmpeq_epi8(chunk, carriageReturn)));
+
+        const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(found));
+        if (mask != 0)
+            return current + lowestBit(mask);
+    }
+#endif
+
+    while (current < end && *current != delimiter && *current != '\n' && *current != '\r')
+        ++current;
+    return current;
+}
+
+bool CsvReader::open(const char* path, char delimiter)
+{
+    close();
+
+    if (!file.open(path)) return false;
+
+    this->delimiter = delimiter;
+    current = file.data();
+    end = current + file.size();
+    return true;
+}
+
+void CsvReader::close()
+{
+    file.close();
+    current = nullptr;
+    end = nullptr;
+}
+
+bool CsvReader::next(std::vector<CsvField>& fields)
+{
+    fields.clear();
+
+    // Empty lines aren't rows
+    while (current < end && (*current == '\n' || *current == '\r'))
+        ++current;
+
+    if (current >= end) return false;
+
+    for (;;)
+    {
+        CsvField field;
+        if (*current == '"')
+        {
+            const char* start = ++current;
+            for (;;)
+            {
+                const char* quote = static_cast<const char*>(memchr(current, '"', end - current));
+                if (quote == nullptr)
+                {
+                    // Missing closing quote, the field takes the rest of the file
+                    current = end;
+                    field.text = std::string_view(start, end - start);
+                    break;
+                }
+
+                if (quote + 1 < end && quote[1] == '"')
+                {
+                    field.escaped = true;
+                    current = quote + 2;
+                    continue;
+                }
+
+                field.text = std::string_view(start, quote - start);
+                current = quote + 1;
+                break;
+            }
+
+            // Anything between the closing quote and the delimiter is ignored
+            current = findFieldEnd(current, end, delimiter);
+        }
+        else
+        {
+            const char* start = current;
+            current = findFieldEnd(current, end, delimiter);
+            field.text = std::string_view(start, current - start);
+        }
+
+        fields.push_back(field);
+
+        if (current < end && *current == delimiter)
+        {
+            ++current;
+            if (current < end) continue;
+
+            // Delimiter at the end of the file, the last field is empty
+            fields.push_back(CsvField());
+        }
+
+        if (current < end && *current == '\r') ++current;
+        if (current < end && *current == '\n') ++current;
+        return true;
+    }
+}
+
+ObjString* csvFieldString(const CsvField& field, std::string& scratch)
+{
+    if (!field.escaped)
+        return takeString(field.text.data(), static_cast<int>(field.text.length()));
+
+    scratch.clear();
+    for (size_t i = 0; i < field.text.length(); ++i)
+    {
+        scratch += field.text[i];
+
+        // Quotes are doubled inside quoted fields
+        if (field.text[i] == '"')
+            ++i;
+    }
+    return takeString(scratch.data(), static_cast<int>(scratch.length()));
+}
+
+// Plain decimals with up to 15 digits, like most numbers in a CSV file, are exact as a double
+// and so is their division by a power of ten up to 1e22, so the result is correctly rounded
+static bool parseSimpleNumber(std::string_view text, double* number)
+{
+    static const double powersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+
+    size_t i = 0;
+    const bool negative = text[0] == '-';
+    if (negative) ++i;
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int decimals = -1;
+    for (; i < text.length(); ++i)
+    {
+        const char c = text[i];
+        if (c >= '0' && c <= '9')
+        {
+            mantissa = mantissa * 10 + (c - '0');
+            ++digits;
+            if (decimals >= 0) ++decimals;
+        }
+        else if (c == '.' && decimals < 0)
+        {
+            decimals = 0;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    if (digits == 0 || digits > 15) return false;
+
+    double value = static_cast<double>(mantissa);
+    if (decimals > 0) value /= powersOfTen[decimals];
+    *number = negative ? -value : value;
+    return true;
+}
+
+static bool parseNumber(std::string_view text, double* number)
+{
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) text.remove_suffix(1);
+    if (text.empty()) return false;
+
+    if (parseSimpleNumber(text, number)) return true;
+
+    const char* last = text.data() + text.length();
+    const std::from_chars_result result = std::from_chars(text.data(), last, *number);
+    return result.ec == std::errc() && result.ptr == last;
+}
+
+bool csvColumns(const char* path, char delimiter, Value* result)
+{
+    CsvReader reader;
+    if (!reader.open(path, delimiter)) return false;
+
+    VM* vm = &VM::getInstance();
+    std::string scratch;
+
+    ObjMap* map = newMap();
+    vm->push(Value(map));
+
+    std::vector<CsvField> fields;
+    if (!reader.next(fields))
+    {
+        vm->pop();
+        *result = Value(map);
+        return true;
+    }
+
+    // Names are kept rooted in a list until the map is built, the fields are only valid while the file is open
+    ObjList* names = newList();
+    vm->push(Value(names));
+    for (const CsvField& field : fields)
+    {
+        names->append(Value(csvFieldString(field, scratch)));
+    }
+    const size_t columnCount = names->items.size();
+
+    // A column is numeric when its first non empty fields all are numbers
+    const size_t dataStart = reader.position();
+    std::vector<bool> numeric(columnCount, true);
+    std::vector<bool> sampled(columnCount, false);
+    size_t sampleRows = 0;
+    while (sampleRows < CSV_SAMPLE_ROWS && reader.next(fields))
+    {
+        ++sampleRows;
+        for (size_t column = 0; column < columnCount && column < fields.size(); ++column)
+        {
+            if (fields[column].text.empty()) continue;
+
+            double number;
+            sampled[column] = true;
+            if (fields[column].escaped || !parseNumber(fields[column].text, &number))
+                numeric[column] = false;
+        }
+    }
+
+    // Guess of the row count from the size of the sampled rows, so the columns don't keep growing
+    size_t expectedRows = sampleRows;
+    if (sampleRows == CSV_SAMPLE_ROWS)
+    {
+        const double bytesPerRow = static_cast<double>(reader.position() - dataStart) / sampleRows;
+        expectedRows = static_cast<size_t>((reader.size() - dataStart) / bytesPerRow * 1.1);
+    }
+    reader.seek(dataStart);
+
+    ObjList* columns = newList();
+    vm->push(Value(columns));
+    std::vector<ObjFloatArray*> numberColumns(columnCount, nullptr);
+    std::vector<ObjList*> stringColumns(columnCount, nullptr);
+    for (size_t column = 0; column < columnCount; ++column)
+    {
+        if (numeric[column] && sampled[column])
+        {
+            numberColumns[column] = newFloatArray();
+            numberColumns[column]->items.reserve(expectedRows);
+            columns->append(Value(numberColumns[column]));
+        }
+        else
+        {
+            stringColumns[column] = newList();
+            stringColumns[column]->items.reserve(expectedRows);
+            columns->append(Value(stringColumns[column]));
+        }
+    }
+
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const CsvField empty;
+    while (reader.next(fields))
+    {
+        for (size_t column = 0; column < columnCount; ++column)
+        {
+            // Short rows are padded with empty fields, extra fields are ignored
+            const CsvField& field = column < fields.size() ? fields[column] : empty;
+            if (numberColumns[column] != nullptr)
+            {
+                double number;
+                numberColumns[column]->append(parseNumber(field.text, &number) ? number : nan);
+            }
+            else
+            {
+                stringColumns[column]->append(Value(csvFieldString(field, scratch)));
+            }
+        }
+    }
+
+    for (size_t column = 0; column < columnCount; ++column)
+    {
+        map->table.set(names->items[column], columns->items[column]);
+    }
+
+    vm->pop(); // columns
+    vm->pop(); // names
+    vm->pop(); // map
+    *result = Value(map);
+    return true;
+}
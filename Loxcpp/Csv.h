@@ -0,0 +1,56 @@
+#ifndef loxcpp_csv_h
+#define loxcpp_csv_h
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "File.h"
+#include "Value.h"
+
+struct ObjString;
+
+struct CsvField
+{
+    std::string_view text = ""; // Without the surrounding quotes
+    bool escaped = false;  // Quoted field with doubled quotes inside, they have to be removed
+};
+
+// Reads the rows of a CSV file mapped in memory. Fields can be quoted to contain the delimiter,
+// line breaks or quotes, which are written twice. Rows end with "\n" or "\r\n", and empty lines are skipped.
+class CsvReader
+{
+public:
+
+    CsvReader() = default;
+    CsvReader(const CsvReader&) = delete;
+    CsvReader& operator=(const CsvReader&) = delete;
+
+    bool open(const char* path, char delimiter);
+    void close();
+
+    // Returns false at the end of the file. Fields point into the mapped file.
+    bool next(std::vector<CsvField>& fields);
+
+    size_t position() const { return current - file.data(); }
+    void seek(size_t position) { current = file.data() + position; }
+    size_t size() const { return file.size(); }
+
+private:
+
+    MappedFile file;
+    const char* current = nullptr;
+    const char* end = nullptr;
+    char delimiter = ',';
+};
+
+// Text of the field as a string, with the doubled quotes removed
+ObjString* csvFieldString(const CsvField& field, std::string& scratch);
+
+// Loads a whole file by columns into a map from the names in the header to the columns.
+// The type of a column is decided by its first rows: if they are numbers, it becomes a float array
+// where the fields that aren't numbers are nan. The rest become lists of strings.
+// Returns false if the file can't be opened.
+bool csvColumns(const char* path, char delimiter, Value* result);
+
+#endif
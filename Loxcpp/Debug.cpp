@@ -192,14 +192,24 @@ size_t disassembleInstruction(const Chunk& chunk, size_t offset)
         return simpleInstruction("OP_INCREMENT", offset);
     case OpCode::OP_BUILD_RANGE:
         return simpleInstruction("OP_BUILD_RANGE", offset);
+    case OpCode::OP_BUILD_RANGE_STEP:
+        return simpleInstruction("OP_BUILD_RANGE_STEP", offset);
     case OpCode::OP_BUILD_LIST:
         return byteInstruction("OP_BUILD_LIST", chunk, offset);
+    case OpCode::OP_BUILD_MAP:
+        return byteInstruction("OP_BUILD_MAP", chunk, offset);
+    case OpCode::OP_BUILD_STRING:
+        return byteInstruction("OP_BUILD_STRING", chunk, offset);
     case OpCode::OP_INDEX_SUBSCR:
         return simpleInstruction("OP_INDEX_SUBSCR", offset);
     case OpCode::OP_STORE_SUBSCR:
         return simpleInstruction("OP_STORE_SUBSCR", offset);
     case OpCode::OP_RANGE_IN_BOUNDS:
         return simpleInstruction("OP_RANGE_IN_BOUNDS", offset);
+    case OpCode::OP_RANGE_VALUE:
+        return simpleInstruction("OP_RANGE_VALUE", offset);
+    case OpCode::OP_RANGE_SETUP:
+        return simpleInstruction("OP_RANGE_SETUP", offset);
     case OpCode::OP_NOT:
         return simpleInstruction("OP_NOT", offset);
     case OpCode::OP_PRINT:
@@ -276,5 +286,5 @@ size_t disassembleInstruction(const Chunk& chunk, size_t offset)
         return offset + 1;
     }
 
-    static_assert(static_cast<int>(OpCode::COUNT) == 54, "Missing operations in the Debug");
+    static_assert(static_cast<int>(OpCode::COUNT) == 59, "Missing operations in the Debug");
 }
\ No newline at end of file
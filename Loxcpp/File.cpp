@@ -0,0 +1,506 @@
+#include "File.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#include <io.h>
+
+bool isTerminal(FILE* stream)
+{
+    return _isatty(_fileno(stream)) != 0;
+}
+#else
+bool isTerminal(FILE* stream)
+{
+    return isatty(fileno(stream)) != 0;
+}
+#endif
+
+// Big enough that reading or writing a file takes few calls, small enough to stay in cache
+#define FILE_BUFFER_SIZE (64 * 1024)
+
+// Files mapped right now, by device and index, with how many times each one is mapped
+static std::map<std::pair<uint64_t, uint64_t>, int> mappedFiles;
+
+static void addMapping(uint64_t device, uint64_t index)
+{
+    ++mappedFiles[{ device, index }];
+}
+
+static void removeMapping(uint64_t device, uint64_t index)
+{
+    const auto found = mappedFiles.find({ device, index });
+    if (found != mappedFiles.end() && --found->second == 0)
+    {
+        mappedFiles.erase(found);
+    }
+}
+
+static bool isMapped(uint64_t device, uint64_t index)
+{
+    return mappedFiles.count({ device, index }) > 0;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : mapped(other.mapped)
+    , length(other.length)
+    , contents(std::move(other.contents))
+    , device(other.device)
+    , index(other.index)
+{
+    other.mapped = nullptr;
+    other.length = 0;
+    other.device = 0;
+    other.index = 0;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char* path)
+{
+    close();
+
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    // Empty files can't be mapped, and neither can pipes or devices
+    LARGE_INTEGER fileSize;
+    BY_HANDLE_FILE_INFORMATION info;
+    if (GetFileType(file) == FILE_TYPE_DISK && GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0
+        && GetFileInformationByHandle(file, &info))
+    {
+        // The view keeps the file and the mapping alive, their handles aren't needed after creating it
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void* view = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (mapping != nullptr) CloseHandle(mapping);
+
+        if (view != nullptr)
+        {
+            CloseHandle(file);
+            mapped = static_cast<const char*>(view);
+            length = static_cast<size_t>(fileSize.QuadPart);
+            device = info.dwVolumeSerialNumber;
+            index = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+            addMapping(device, index);
+            return true;
+        }
+    }
+
+    bool read = true;
+    for (;;)
+    {
+        const size_t start = contents.size();
+        contents.resize(start + FILE_BUFFER_SIZE);
+
+        DWORD count = 0;
+        if (!ReadFile(file, contents.data() + start, FILE_BUFFER_SIZE, &count, nullptr))
+        {
+            // The end of a pipe
+            read = GetLastError() == ERROR_BROKEN_PIPE;
+            count = 0;
+        }
+
+        contents.resize(start + count);
+        if (count == 0) break;
+    }
+    CloseHandle(file);
+
+    if (!read) std::vector<char>().swap(contents);
+    length = contents.size();
+    return read;
+}
+
+void MappedFile::close()
+{
+    if (mapped != nullptr)
+    {
+        UnmapViewOfFile(mapped);
+        removeMapping(device, index);
+    }
+    mapped = nullptr;
+    length = 0;
+    device = 0;
+    index = 0;
+    std::vector<char>().swap(contents);
+}
+
+#else
+
+bool MappedFile::open(const char* path)
+{
+    close();
+
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    // Empty files can't be mapped, and neither can pipes or devices. Files in /proc report no size.
+    if (S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        // The mapping keeps the file alive, the descriptor isn't needed after creating it
+        void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED)
+        {
+            ::close(fd);
+            madvise(view, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+
+            mapped = static_cast<const char*>(view);
+            length = static_cast<size_t>(info.st_size);
+            device = static_cast<uint64_t>(info.st_dev);
+            index = static_cast<uint64_t>(info.st_ino);
+            addMapping(device, index);
+            return true;
+        }
+    }
+
+    bool read = true;
+    for (;;)
+    {
+        const size_t start = contents.size();
+        contents.resize(start + FILE_BUFFER_SIZE);
+
+        const ssize_t count = ::read(fd, contents.data() + start, FILE_BUFFER_SIZE);
+        contents.resize(start + (count > 0 ? static_cast<size_t>(count) : 0));
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0)
+        {
+            read = count == 0;
+            break;
+        }
+    }
+    ::close(fd);
+
+    if (!read) std::vector<char>().swap(contents);
+    length = contents.size();
+    return read;
+}
+
+void MappedFile::close()
+{
+    if (mapped != nullptr)
+    {
+        munmap(const_cast<char*>(mapped), length);
+        removeMapping(device, index);
+    }
+    mapped = nullptr;
+    length = 0;
+    device = 0;
+    index = 0;
+    std::vector<char>().swap(contents);
+}
+
+#endif
+
+bool LineReader::open(const char* path)
+{
+    close();
+
+    file = fopen(path, "rb");
+    if (file == nullptr) return false;
+
+    // The reader does its own buffering
+    setvbuf(file, nullptr, _IONBF, 0);
+    buffer.resize(FILE_BUFFER_SIZE);
+    return true;
+}
+
+void LineReader::close()
+{
+    if (file != nullptr)
+    {
+        fclose(file);
+    }
+    file = nullptr;
+    start = 0;
+    end = 0;
+    pending.clear();
+}
+
+bool LineReader::fill()
+{
+    if (file == nullptr) return false;
+
+    start = 0;
+    end = fread(buffer.data(), 1, buffer.size(), file);
+    return end > 0;
+}
+
+bool LineReader::next(std::string_view& line)
+{
+    pending.clear();
+    bool partial = false;
+
+    for (;;)
+    {
+        if (start == end && !fill())
+        {
+            // Last line of a file that doesn't end with a line break
+            if (!partial) return false;
+            line = pending;
+            return true;
+        }
+
+        const char* begin = buffer.data() + start;
+        const char* lineBreak = static_cast<const char*>(memchr(begin, '\n', end - start));
+        if (lineBreak == nullptr)
+        {
+            pending.append(begin, end - start);
+            partial = true;
+            start = end;
+            continue;
+        }
+
+        const size_t count = lineBreak - begin;
+        start += count + 1;
+
+        if (partial)
+        {
+            pending.append(begin, count);
+            line = pending;
+        }
+        else
+        {
+            // The whole line is in the buffer, so it's not copied
+            line = std::string_view(begin, count);
+        }
+
+        // Windows line breaks
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        return true;
+    }
+}
+
+#ifdef _WIN32
+
+static bool isMappedFile(const char* path)
+{
+    HANDLE file = CreateFileA(path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    BY_HANDLE_FILE_INFORMATION info;
+    const bool mapped = GetFileType(file) == FILE_TYPE_DISK && GetFileInformationByHandle(file, &info)
+        && isMapped(info.dwVolumeSerialNumber, (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow);
+    CloseHandle(file);
+    return mapped;
+}
+
+// Creates a file with a unique name next to the target, in the same volume so it can be moved over it
+static FILE* createReplacement(const char* path, std::string& target, std::string& temporary)
+{
+    target = path;
+    const size_t slash = target.find_last_of("/\\");
+    const std::string directory = slash == std::string::npos ? "." : target.substr(0, slash + 1);
+
+    char name[MAX_PATH];
+    if (GetTempFileNameA(directory.c_str(), "lox", 0, name) == 0) return nullptr;
+
+    FILE* file = fopen(name, "wb");
+    if (file == nullptr)
+    {
+        DeleteFileA(name);
+        return nullptr;
+    }
+
+    temporary = name;
+    return file;
+}
+
+static bool replaceFile(const std::string& from, const std::string& to)
+{
+    // Fails while the file is in use, the old file is kept then
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+#else
+
+static bool isMappedFile(const char* path)
+{
+    struct stat info;
+    return stat(path, &info) == 0 && S_ISREG(info.st_mode)
+        && isMapped(static_cast<uint64_t>(info.st_dev), static_cast<uint64_t>(info.st_ino));
+}
+
+// Creates a file with a unique name next to the target, in the same file system so it can be renamed over it
+static FILE* createReplacement(const char* path, std::string& target, std::string& temporary)
+{
+    // Links are followed, the file they point to is the one replaced
+    char* resolved = realpath(path, nullptr);
+    if (resolved == nullptr) return nullptr;
+    target = resolved;
+    free(resolved);
+
+    struct stat info;
+    if (stat(target.c_str(), &info) != 0) return nullptr;
+
+    std::string name = target + ".XXXXXX";
+    const int fd = mkstemp(name.data());
+    if (fd < 0) return nullptr;
+
+    // Only root can give a file to another owner, the permissions are kept in any case
+    fchmod(fd, info.st_mode & 07777);
+    if (fchown(fd, info.st_uid, info.st_gid) != 0) {}
+
+    FILE* file = fdopen(fd, "wb");
+    if (file == nullptr)
+    {
+        ::close(fd);
+        remove(name.c_str());
+        return nullptr;
+    }
+
+    temporary = name;
+    return file;
+}
+
+static bool replaceFile(const std::string& from, const std::string& to)
+{
+    // The old file stays alive as long as something maps it
+    return rename(from.c_str(), to.c_str()) == 0;
+}
+
+#endif
+
+bool FileWriter::open(const char* path, bool append)
+{
+    close();
+
+    if (append)
+    {
+        // Appending doesn't change the bytes that are already mapped
+        file = fopen(path, "ab");
+    }
+    else if (isMappedFile(path))
+    {
+        file = createReplacement(path, target, temporary);
+    }
+    else
+    {
+        file = fopen(path, "wb");
+    }
+
+    if (file == nullptr)
+    {
+        target.clear();
+        temporary.clear();
+        return false;
+    }
+
+    // The writer does its own buffering
+    setvbuf(file, nullptr, _IONBF, 0);
+    buffer.resize(FILE_BUFFER_SIZE);
+    used = 0;
+    return true;
+}
+
+bool FileWriter::close()
+{
+    bool written = file != nullptr && flush();
+    if (file != nullptr)
+    {
+        written = fclose(file) == 0 && written;
+    }
+
+    // A replacement that failed to be written leaves the target as it was
+    if (!temporary.empty())
+    {
+        remove(temporary.c_str());
+    }
+
+    file = nullptr;
+    used = 0;
+    failed = false;
+    target.clear();
+    temporary.clear();
+    std::vector<char>().swap(buffer);
+    return written;
+}
+
+bool FileWriter::write(const char* data, size_t size)
+{
+    if (file == nullptr) return false;
+
+    if (used + size > buffer.size())
+    {
+        if (!drain()) return false;
+
+        // Too big to be worth buffering
+        if (size >= buffer.size())
+        {
+            failed = failed || fwrite(data, 1, size, file) != size;
+            return !failed;
+        }
+    }
+
+    memcpy(buffer.data() + used, data, size);
+    used += size;
+    return true;
+}
+
+bool FileWriter::flush()
+{
+    if (file == nullptr) return false;
+
+    const bool written = drain() && !failed;
+    if (written && !temporary.empty())
+    {
+        return replaceTarget();
+    }
+    return written;
+}
+
+bool FileWriter::drain()
+{
+    if (file == nullptr) return false;
+
+    const bool written = fwrite(buffer.data(), 1, used, file) == used && fflush(file) == 0;
+    failed = failed || !written;
+    used = 0;
+    return written;
+}
+
+// The mappings keep the old file, the writer goes on appending to the one that took its place
+bool FileWriter::replaceTarget()
+{
+    const bool replaced = fclose(file) == 0 && replaceFile(temporary, target);
+    if (!replaced)
+    {
+        remove(temporary.c_str());
+    }
+    temporary.clear();
+
+    file = replaced ? fopen(target.c_str(), "ab") : nullptr;
+    if (file != nullptr)
+    {
+        setvbuf(file, nullptr, _IONBF, 0);
+    }
+    failed = failed || file == nullptr;
+    return file != nullptr;
+}
+
+bool writeWholeFile(const char* path, const char* data, size_t size)
+{
+    FileWriter writer;
+    return writer.open(path, false) && writer.write(data, size) && writer.close();
+}
@@ -0,0 +1,124 @@
+#ifndef loxcpp_file_h
+#define loxcpp_file_h
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// True when the stream is an interactive terminal rather than a file or a pipe
+bool isTerminal(FILE* stream);
+
+// Read only view of a whole file mapped in memory. Pages are loaded by the OS when they are touched,
+// so a big file doesn't have to be resident to be used. Files that can't be mapped, like pipes, devices
+// or the ones in /proc that report no size, are read into memory instead.
+class MappedFile
+{
+public:
+
+    MappedFile() = default;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    bool open(const char* path);
+    void close();
+
+    const char* data() const { return mapped != nullptr ? mapped : (contents.empty() ? "" : contents.data()); }
+    size_t size() const { return length; }
+
+private:
+
+    const char* mapped = nullptr;
+    size_t length = 0;
+    std::vector<char> contents; // What was read when the file couldn't be mapped
+    uint64_t device = 0;        // Identity of the mapped file, writers replace it instead of truncating it
+    uint64_t index = 0;
+};
+
+// Reads a file one line at a time through a fixed size buffer, so memory use doesn't depend on the file size.
+class LineReader
+{
+public:
+
+    LineReader() = default;
+    LineReader(const LineReader&) = delete;
+    LineReader& operator=(const LineReader&) = delete;
+
+    ~LineReader()
+    {
+        close();
+    }
+
+    bool open(const char* path);
+    void close();
+
+    // Returns false at the end of the file. The line doesn't include the line break,
+    // and it's only valid until the next call.
+    bool next(std::string_view& line);
+
+private:
+
+    bool fill();
+
+    FILE* file = nullptr;
+    std::vector<char> buffer;
+    size_t start = 0;
+    size_t end = 0;
+    std::string pending; // Start of a line that continues after the end of the buffer
+};
+
+// Writes to a file through a fixed size buffer, so many small writes turn into few system calls.
+// Whatever is still buffered is written when the writer is flushed, closed or destroyed.
+// A file that is mapped by a MappedFile isn't truncated, the mapping would break: the content goes to a
+// temporary file next to it, which takes its place on the first flush. The mapping keeps the old content.
+class FileWriter
+{
+public:
+
+    FileWriter() = default;
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+
+    ~FileWriter()
+    {
+        close();
+    }
+
+    // Truncates the file, or appends to it
+    bool open(const char* path, bool append);
+
+    // Returns false if anything failed to be written
+    bool close();
+    bool isOpen() const { return file != nullptr; }
+
+    bool write(const char* data, size_t size);
+
+    // Makes what was written visible in the file
+    bool flush();
+
+    size_t capacity() const { return buffer.capacity(); }
+
+private:
+
+    bool drain();
+    bool replaceTarget();
+
+    FILE* file = nullptr;
+    std::vector<char> buffer;
+    size_t used = 0;
+    bool failed = false;
+    std::string target;    // Mapped file being replaced
+    std::string temporary; // Where its new content is written until it's flushed
+};
+
+// Writes a whole file at once, like FileWriter does
+bool writeWholeFile(const char* path, const char* data, size_t size);
+
+#endif
@@ -3,6 +3,15 @@
 #include "Object.h"
 #include "Vm.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TABLE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 #define TABLE_MAX_LOAD 0.75
 
 size_t Hasher::operator()(ObjString* key) const
@@ -188,7 +197,7 @@ ObjString* TableLox::findString(const char* chars, int length, uint32_t hash)
         }
         else if (entry->key->length == length &&
             entry->key->hash == hash &&
-            memcmp(&entry->key->chars[0], chars, length) == 0)
+            memcmp(entry->key->chars(), chars, length) == 0)
         {
             // We found it.
             return entry->key;
@@ -240,3 +249,487 @@ void TableLox::Clear()
     count = 0;
     capacity = 0;
 }
+
+// Control bytes of TableSwiss: full slots store the low 7 bits of the hash, so they are never negative
+#define CTRL_EMPTY int8_t(-128)
+#define CTRL_DELETED int8_t(-2)
+#define GROUP_SIZE 16
+
+static inline int lowestBit(uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// Bitmasks of the control bytes of a group that match a condition, bit i is slot i of the group
+struct ControlGroup
+{
+    explicit ControlGroup(const int8_t* ctrl)
+#ifdef TABLE_SSE2
+        : bytes(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl)))
+    {}
+
+    uint32_t match(int8_t h2) const
+    {
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(h2))));
+    }
+
+    uint32_t matchEmpty() const
+    {
+        return match(CTRL_EMPTY);
+    }
+
+    uint32_t matchEmptyOrDeleted() const
+    {
+        // Both have the sign bit set
+        return static_cast<uint32_t>(_mm_movemask_epi8(bytes));
+    }
+
+    __m128i bytes;
+#else
+        : bytes(ctrl)
+    {}
+
+    uint32_t match(int8_t h2) const
+    {
+        uint32_t mask = 0;
+        for (int i = 0; i < GROUP_SIZE; ++i)
+        {
+            if (bytes[i] == h2) mask |= 1u << i;
+        }
+        return mask;
+    }
+
+    uint32_t matchEmpty() const
+    {
+        return match(CTRL_EMPTY);
+    }
+
+    uint32_t matchEmptyOrDeleted() const
+    {
+        uint32_t mask = 0;
+        for (int i = 0; i < GROUP_SIZE; ++i)
+        {
+            if (bytes[i] < 0) mask |= 1u << i;
+        }
+        return mask;
+    }
+
+    const int8_t* bytes;
+#endif
+};
+
+// The high bits of the hash select the first group to probe, the low 7 bits are stored in the control byte
+static inline size_t hashGroup(uint32_t hash) { return hash >> 7; }
+static inline int8_t hashControl(uint32_t hash) { return static_cast<int8_t>(hash & 0x7F); }
+
+// Tables with fewer slots are rehashed at once, copying them is cheaper than slowing down the next operations
+#define INCREMENTAL_REHASH_MIN_CAPACITY (1 << 16)
+#define MIGRATE_GROUPS_PER_OPERATION 8
+
+size_t TableSwiss::Storage::findSlot(const ObjString* key, uint32_t hash) const
+{
+    if (count == 0) return SIZE_MAX;
+
+    // Groups are visited with triangular steps, which covers all of them for a power of two group count
+    const size_t groupMask = control.size() / GROUP_SIZE - 1;
+    size_t group = hashGroup(hash) & groupMask;
+    for (size_t step = 1;; ++step)
+    {
+        const size_t first = group * GROUP_SIZE;
+        const ControlGroup ctrl(&control[first]);
+        for (uint32_t match = ctrl.match(hashControl(hash)); match != 0; match &= match - 1)
+        {
+            const size_t slot = first + lowestBit(match);
+            if (slots[slot].key == key) return slot;
+        }
+
+        // An empty slot ends the probe sequence, the key would have been inserted there
+        if (ctrl.matchEmpty() != 0) return SIZE_MAX;
+
+        group = (group + step) & groupMask;
+    }
+}
+
+size_t TableSwiss::Storage::findInsertSlot(uint32_t hash) const
+{
+    const size_t groupMask = control.size() / GROUP_SIZE - 1;
+    size_t group = hashGroup(hash) & groupMask;
+    for (size_t step = 1;; ++step)
+    {
+        const size_t first = group * GROUP_SIZE;
+        const uint32_t available = ControlGroup(&control[first]).matchEmptyOrDeleted();
+        if (available != 0) return first + lowestBit(available);
+
+        group = (group + step) & groupMask;
+    }
+}
+
+ObjString* TableSwiss::Storage::findString(const char* chars, int length, uint32_t hash) const
+{
+    if (count == 0) return nullptr;
+
+    const size_t groupMask = control.size() / GROUP_SIZE - 1;
+    size_t group = hashGroup(hash) & groupMask;
+    for (size_t step = 1;; ++step)
+    {
+        const size_t first = group * GROUP_SIZE;
+        const ControlGroup ctrl(&control[first]);
+        for (uint32_t match = ctrl.match(hashControl(hash)); match != 0; match &= match - 1)
+        {
+            ObjString* key = slots[first + lowestBit(match)].key;
+            if (key->length == length &&
+                key->hash == hash &&
+                memcmp(key->chars(), chars, length) == 0)
+            {
+                return key;
+            }
+        }
+
+        if (ctrl.matchEmpty() != 0) return nullptr;
+
+        group = (group + step) & groupMask;
+    }
+}
+
+void TableSwiss::Storage::insert(size_t slot, ObjString* key, const Value& value)
+{
+    if (control[slot] == CTRL_EMPTY) growthLeft--;
+
+    control[slot] = hashControl(key->hash);
+    slots[slot].key = key;
+    slots[slot].value = value;
+    count++;
+}
+
+void TableSwiss::Storage::erase(size_t slot)
+{
+    // If the group still has an empty slot no probe sequence ever went past it,
+    // so the slot can be emptied instead of leaving a tombstone
+    const size_t first = slot & ~size_t(GROUP_SIZE - 1);
+    if (ControlGroup(&control[first]).matchEmpty() != 0)
+    {
+        control[slot] = CTRL_EMPTY;
+        growthLeft++;
+    }
+    else
+    {
+        control[slot] = CTRL_DELETED;
+    }
+
+    slots[slot] = Entry();
+    count--;
+}
+
+void TableSwiss::Storage::mark()
+{
+    VM& vm = VM::getInstance();
+    for (size_t i = 0; i < control.size(); ++i)
+    {
+        if (control[i] < 0) continue;
+
+        vm.markObject(slots[i].key);
+        vm.markValue(slots[i].value);
+    }
+}
+
+void TableSwiss::Storage::removeWhite()
+{
+    for (size_t i = 0; i < control.size(); ++i)
+    {
+        if (control[i] >= 0 && !slots[i].key->isMarked)
+        {
+            erase(i);
+        }
+    }
+}
+
+TableSwiss::TableSwiss()
+    : current()
+    , previous()
+    , migratedGroups(0)
+{}
+
+void TableSwiss::resize(size_t nextCapacity)
+{
+    // A resize still in progress is finished before starting another one
+    migrate(SIZE_MAX);
+
+    std::swap(previous, current);
+    current.count = 0;
+    current.control.assign(nextCapacity, CTRL_EMPTY);
+    current.slots.reset(static_cast<Entry*>(calloc(nextCapacity, sizeof(Entry))));
+    // Keep 1/8 of the slots empty so probe sequences stay short
+    current.growthLeft = nextCapacity - nextCapacity / 8;
+    migratedGroups = 0;
+
+    if (previous.control.size() < INCREMENTAL_REHASH_MIN_CAPACITY)
+    {
+        migrate(SIZE_MAX);
+    }
+}
+
+void TableSwiss::migrate(size_t groups)
+{
+    if (previous.control.empty()) return;
+
+    const size_t groupCount = previous.control.size() / GROUP_SIZE;
+    const size_t lastGroup = groups < groupCount - migratedGroups ? migratedGroups + groups : groupCount;
+    for (; migratedGroups < lastGroup; ++migratedGroups)
+    {
+        const size_t first = migratedGroups * GROUP_SIZE;
+        for (size_t slot = first; slot < first + GROUP_SIZE; ++slot)
+        {
+            if (previous.control[slot] < 0) continue;
+
+            const Entry& entry = previous.slots[slot];
+            current.insert(current.findInsertSlot(entry.key->hash), entry.key, entry.value);
+
+            // A tombstone keeps the probe sequences of the entries not moved yet
+            previous.control[slot] = CTRL_DELETED;
+            previous.slots[slot] = Entry();
+            previous.count--;
+        }
+    }
+
+    if (migratedGroups == groupCount)
+    {
+        previous = Storage();
+    }
+}
+
+bool TableSwiss::set(ObjString* key, const Value& value)
+{
+    migrate(MIGRATE_GROUPS_PER_OPERATION);
+
+    const uint32_t hash = key->hash;
+
+    size_t found = current.findSlot(key, hash);
+    if (found != SIZE_MAX)
+    {
+        current.slots[found].value = value;
+        return false;
+    }
+
+    found = previous.findSlot(key, hash);
+    if (found != SIZE_MAX)
+    {
+        previous.slots[found].value = value;
+        return false;
+    }
+
+    if (current.control.empty())
+    {
+        resize(GROUP_SIZE);
+    }
+
+    size_t slot = current.findInsertSlot(hash);
+    if (current.control[slot] == CTRL_EMPTY && current.growthLeft == 0)
+    {
+        // Grow if the table is actually full, otherwise rehashing at the same size is enough to clear the tombstones
+        const size_t capacity = current.control.size();
+        const size_t count = current.count + previous.count;
+        resize(count + 1 > (capacity - capacity / 8) / 2 ? capacity * 2 : capacity);
+        slot = current.findInsertSlot(hash);
+    }
+
+    current.insert(slot, key, value);
+    return true;
+}
+
+bool TableSwiss::get(ObjString* key, Value* value)
+{
+    migrate(MIGRATE_GROUPS_PER_OPERATION);
+
+    size_t found = current.findSlot(key, key->hash);
+    if (found != SIZE_MAX)
+    {
+        *value = current.slots[found].value;
+        return true;
+    }
+
+    found = previous.findSlot(key, key->hash);
+    if (found != SIZE_MAX)
+    {
+        *value = previous.slots[found].value;
+        return true;
+    }
+
+    return false;
+}
+
+bool TableSwiss::remove(ObjString* key)
+{
+    migrate(MIGRATE_GROUPS_PER_OPERATION);
+
+    size_t found = current.findSlot(key, key->hash);
+    if (found != SIZE_MAX)
+    {
+        current.erase(found);
+        return true;
+    }
+
+    found = previous.findSlot(key, key->hash);
+    if (found != SIZE_MAX)
+    {
+        previous.erase(found);
+        return true;
+    }
+
+    return false;
+}
+
+ObjString* TableSwiss::findString(const char* chars, int length, uint32_t hash)
+{
+    migrate(MIGRATE_GROUPS_PER_OPERATION);
+
+    ObjString* found = current.findString(chars, length, hash);
+    return found != nullptr ? found : previous.findString(chars, length, hash);
+}
+
+void TableSwiss::mark()
+{
+    current.mark();
+    previous.mark();
+}
+
+void TableSwiss::removeWhite()
+{
+    current.removeWhite();
+    previous.removeWhite();
+}
+
+ValueTable::ValueTable()
+    : slots()
+    , entries()
+{}
+
+size_t ValueTable::findSlot(const Value& key, uint32_t hash) const
+{
+    if (slots.empty()) return SIZE_MAX;
+
+    const size_t mask = slots.size() - 1;
+    for (size_t index = hash & mask;; index = (index + 1) & mask)
+    {
+        const Slot& slot = slots[index];
+        if (slot.index == EMPTY_SLOT) return SIZE_MAX;
+        if (slot.hash == hash && entries[slot.index].key == key) return index;
+    }
+}
+
+size_t ValueTable::findSlotOfEntry(uint32_t entryIndex, uint32_t hash) const
+{
+    const size_t mask = slots.size() - 1;
+    for (size_t index = hash & mask;; index = (index + 1) & mask)
+    {
+        if (slots[index].index == entryIndex) return index;
+    }
+}
+
+void ValueTable::adjustCapacity(size_t nextCapacity)
+{
+    std::vector<Slot> nextSlots(nextCapacity, Slot{ EMPTY_SLOT, 0 });
+
+    const size_t mask = nextCapacity - 1;
+    for (const Slot& slot : slots)
+    {
+        if (slot.index == EMPTY_SLOT) continue;
+
+        size_t index = slot.hash & mask;
+        while (nextSlots[index].index != EMPTY_SLOT)
+        {
+            index = (index + 1) & mask;
+        }
+        nextSlots[index] = slot;
+    }
+
+    std::swap(slots, nextSlots);
+}
+
+bool ValueTable::set(const Value& key, const Value& value)
+{
+    const uint32_t hash = hashValue(key);
+
+    const size_t found = findSlot(key, hash);
+    if (found != SIZE_MAX)
+    {
+        entries[slots[found].index].value = value;
+        return false;
+    }
+
+    if (entries.size() + 1 > slots.size() * TABLE_MAX_LOAD)
+    {
+        adjustCapacity(slots.size() < 8 ? 8 : slots.size() * 2);
+    }
+
+    const size_t mask = slots.size() - 1;
+    size_t index = hash & mask;
+    while (slots[index].index != EMPTY_SLOT)
+    {
+        index = (index + 1) & mask;
+    }
+
+    slots[index] = Slot{ static_cast<uint32_t>(entries.size()), hash };
+    entries.push_back(ValueEntry{ key, value });
+    return true;
+}
+
+bool ValueTable::get(const Value& key, Value* value) const
+{
+    const size_t found = findSlot(key, hashValue(key));
+    if (found == SIZE_MAX) return false;
+
+    *value = entries[slots[found].index].value;
+    return true;
+}
+
+bool ValueTable::contains(const Value& key) const
+{
+    return findSlot(key, hashValue(key)) != SIZE_MAX;
+}
+
+bool ValueTable::remove(const Value& key)
+{
+    size_t hole = findSlot(key, hashValue(key));
+    if (hole == SIZE_MAX) return false;
+
+    const uint32_t removedIndex = slots[hole].index;
+
+    // Shift back the slots that probed past the removed one, so no tombstone is needed
+    const size_t mask = slots.size() - 1;
+    for (size_t next = (hole + 1) & mask; slots[next].index != EMPTY_SLOT; next = (next + 1) & mask)
+    {
+        const size_t ideal = slots[next].hash & mask;
+        if (((next - ideal) & mask) >= ((next - hole) & mask))
+        {
+            slots[hole] = slots[next];
+            hole = next;
+        }
+    }
+    slots[hole].index = EMPTY_SLOT;
+
+    // Move the last entry into the removed one, so entries stay dense
+    const uint32_t lastIndex = static_cast<uint32_t>(entries.size() - 1);
+    if (removedIndex != lastIndex)
+    {
+        entries[removedIndex] = entries[lastIndex];
+        slots[findSlotOfEntry(lastIndex, hashValue(entries[removedIndex].key))].index = removedIndex;
+    }
+    entries.pop_back();
+    return true;
+}
+
+void ValueTable::mark()
+{
+    VM& vm = VM::getInstance();
+    for (ValueEntry& entry : entries)
+    {
+        vm.markValue(entry.key);
+        vm.markValue(entry.value);
+    }
+}
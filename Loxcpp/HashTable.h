@@ -5,6 +5,7 @@
 #include "Value.h"
 
 #include <unordered_map>
+#include <memory>
 
 struct ObjString;
 
@@ -78,6 +79,138 @@ private:
     std::vector<Entry> entries;
 };
 
-using Table = TableLox;
+// Open addressing table in the style of Abseil's Swiss tables.
+// A separate array of control bytes holds 7 bits of the hash of each key, or marks the slot as empty or deleted.
+// Slots are probed in groups of 16 control bytes compared at once, so the key/value slots are only
+// read when their control byte matches.
+// Big tables grow incrementally: the old storage is kept next to the new one and a few groups
+// are moved on every operation, so no single operation pays for rehashing the whole table.
+struct TableSwiss
+{
+    TableSwiss();
+
+    bool set(ObjString* key, const Value& value);
+    bool get(ObjString* key, Value* value);
+    bool remove(ObjString* key);
+    ObjString* findString(const char* chars, int length, uint32_t hash);
+    void mark();
+    void removeWhite();
+    size_t getSize() const
+    {
+        return sizeof(TableSwiss) + current.getSize() + previous.getSize();
+    }
+
+    // Visits every entry, in no particular order
+    template<typename F>
+    void forEach(F function) const
+    {
+        previous.forEach(function);
+        current.forEach(function);
+    }
+
+private:
+    // Control bytes and slots of one generation of the table
+    struct Storage
+    {
+        size_t findSlot(const ObjString* key, uint32_t hash) const;
+        size_t findInsertSlot(uint32_t hash) const;
+        ObjString* findString(const char* chars, int length, uint32_t hash) const;
+        void insert(size_t slot, ObjString* key, const Value& value);
+        void erase(size_t slot);
+        void mark();
+        void removeWhite();
+        template<typename F>
+        void forEach(F& function) const
+        {
+            for (size_t i = 0; i < control.size(); ++i)
+            {
+                if (control[i] >= 0)
+                    function(slots[i].key, slots[i].value);
+            }
+        }
+
+        size_t getSize() const
+        {
+            size_t valuesSize = 0;
+            for (size_t i = 0; i < control.size(); ++i)
+            {
+                if (control[i] >= 0)
+                    valuesSize += sizeOf(slots[i].value);
+            }
+            return control.size() * (sizeof(int8_t) + sizeof(ObjString*)) + valuesSize;
+        }
+
+        struct FreeSlots
+        {
+            void operator()(Entry* slots) const { free(slots); }
+        };
+
+        size_t count = 0;
+        size_t growthLeft = 0; // Empty slots that can still be filled before the table has to grow
+        std::vector<int8_t> control;
+        // Allocated with calloc, so the pages of a big table are only zeroed once they are used
+        std::unique_ptr<Entry[], FreeSlots> slots;
+    };
+
+    void resize(size_t capacity);
+    void migrate(size_t groups);
+
+    Storage current;
+    Storage previous; // Storage being moved into current, empty when no resize is in progress
+    size_t migratedGroups;
+};
+
+struct ValueEntry
+{
+    Value key;
+    Value value;
+};
+
+// Hash table keyed by any Value, used by maps and sets.
+// Entries are stored densely in insertion order, so they can be iterated by index.
+// Probing happens on a separate power of two array of 8 byte slots (entry index + hash),
+// so a lookup only touches the entries whose hash matches. Removal shifts the following slots back
+// instead of leaving tombstones, and moves the last entry into the hole to keep entries dense.
+struct ValueTable
+{
+    ValueTable();
+
+    bool set(const Value& key, const Value& value);
+    bool get(const Value& key, Value* value) const;
+    bool contains(const Value& key) const;
+    bool remove(const Value& key);
+    void mark();
+
+    size_t count() const { return entries.size(); }
+    const ValueEntry& entryAt(size_t index) const { return entries[index]; }
+
+    size_t getSize() const
+    {
+        size_t entriesSize = 0;
+        for (const ValueEntry& entry : entries)
+        {
+            entriesSize += sizeOf(entry.key) + sizeOf(entry.value);
+        }
+        return sizeof(ValueTable) + entriesSize + slots.size() * sizeof(Slot);
+    }
+
+private:
+    struct Slot
+    {
+        uint32_t index;
+        uint32_t hash;
+    };
+
+    static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+
+    size_t findSlot(const Value& key, uint32_t hash) const;
+    size_t findSlotOfEntry(uint32_t index, uint32_t hash) const;
+    void adjustCapacity(size_t capacity);
+
+    std::vector<Slot> slots;
+    std::vector<ValueEntry> entries;
+};
+
+using Table = TableSwiss;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,835 @@
+#include "Json.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <iterator>
+
+#include "Object.h"
+#include "Vm.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JSON_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Deeper documents are rejected, the parser and the serializer recurse once per level
+#define JSON_MAX_DEPTH 512
+
+// Big enough that reading a file takes few calls, small enough to stay in cache
+#define JSON_BUFFER_SIZE (64 * 1024)
+
+static inline int lowestBit(uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// Finds the first quote, backslash or control character. Everything before it is copied as is,
+// both when reading and writing strings, so most strings are scanned 16 bytes at a time.
+static const char* findStringSpecial(const char* current, const char* end)
+{
+#ifdef JSON_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i lastControl = _mm_set1_epi8(0x1F);
+    for (; current + 16 <= end; current += 16)
+    {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current));
+
+        // Bytes below 0x20 are the ones the unsigned minimum with 0x1F leaves unchanged
+        const __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(chunk, lastControl), chunk);
+        const __m128i special = _mm_or_si128(control,
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+
+        const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(special));
+        if (mask != 0)
+            return current + lowestBit(mask);
+    }
+#endif
+
+    for (; current < end; ++current)
+    {
+        const unsigned char c = static_cast<unsigned char>(*current);
+        if (c == '"' || c == '\\' || c < 0x20)
+            return current;
+    }
+    return end;
+}
+
+static inline bool isJsonWhitespace(int c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static int hexDigit(int c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static void appendUtf8(std::string& out, uint32_t codepoint)
+{
+    if (codepoint < 0x80)
+    {
+        out += static_cast<char>(codepoint);
+    }
+    else if (codepoint < 0x800)
+    {
+        out += static_cast<char>(0xC0 | (codepoint >> 6));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+    else if (codepoint < 0x10000)
+    {
+        out += static_cast<char>(0xE0 | (codepoint >> 12));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+    else
+    {
+        out += static_cast<char>(0xF0 | (codepoint >> 18));
+        out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+}
+
+template<typename Source>
+static bool readHex4(Source& source, uint32_t& value)
+{
+    value = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        const int digit = hexDigit(source.get());
+        if (digit < 0) return false;
+        value = (value << 4) | static_cast<uint32_t>(digit);
+    }
+    return true;
+}
+
+// Decodes the escape sequence after a backslash. Source only needs a get() that returns -1 at the end.
+template<typename Source>
+static bool readEscape(Source& source, std::string& out)
+{
+    switch (source.get())
+    {
+    case '"': out += '"'; return true;
+    case '\\': out += '\\'; return true;
+    case '/': out += '/'; return true;
+    case 'b': out += '\b'; return true;
+    case 'f': out += '\f'; return true;
+    case 'n': out += '\n'; return true;
+    case 'r': out += '\r'; return true;
+    case 't': out += '\t'; return true;
+    case 'u':
+    {
+        uint32_t codepoint;
+        if (!readHex4(source, codepoint)) return false;
+
+        // Characters outside the basic plane are written as a pair of surrogates
+        if (codepoint >= 0xD800 && codepoint <= 0xDBFF)
+        {
+            uint32_t low;
+            if (source.get() != '\\' || source.get() != 'u' || !readHex4(source, low)) return false;
+            if (low < 0xDC00 || low > 0xDFFF) return false;
+            codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+        }
+        else if (codepoint >= 0xDC00 && codepoint <= 0xDFFF)
+        {
+            return false;
+        }
+
+        appendUtf8(out, codepoint);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// Length of the number at the start of the text following the JSON grammar, or 0 if there isn't one.
+// from_chars alone would also take things like "inf" or "1." that aren't JSON.
+static size_t numberLength(const char* start, const char* end)
+{
+    const char* current = start;
+    auto isDigit = [&]() { return current < end && *current >= '0' && *current <= '9'; };
+
+    if (current < end && *current == '-') ++current;
+
+    if (current < end && *current == '0')
+    {
+        ++current;
+    }
+    else if (isDigit())
+    {
+        while (isDigit()) ++current;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (current < end && *current == '.')
+    {
+        ++current;
+        if (!isDigit()) return 0;
+        while (isDigit()) ++current;
+    }
+
+    if (current < end && (*current == 'e' || *current == 'E'))
+    {
+        ++current;
+        if (current < end && (*current == '+' || *current == '-')) ++current;
+        if (!isDigit()) return 0;
+        while (isDigit()) ++current;
+    }
+
+    return current - start;
+}
+
+// Converts a number already checked by numberLength. Numbers too big or too small for a double
+// become infinity or zero with their sign, like strtod does.
+static double convertNumber(const char* first, const char* last)
+{
+    double number = 0.0;
+    const std::from_chars_result result = std::from_chars(first, last, number);
+    if (result.ec == std::errc::result_out_of_range)
+        return strtod(std::string(first, last).c_str(), nullptr);
+    return number;
+}
+
+// Parser for documents that are already in memory.
+// Containers that are still being filled are kept in a list on the VM stack, so the GC can reach them.
+struct JsonParser
+{
+    JsonParser(ObjString* source, ObjList* open)
+        : source(source)
+        , begin(source->chars())
+        , current(begin)
+        , end(begin + source->length)
+        , open(open)
+    {}
+
+    int get()
+    {
+        return current < end ? static_cast<unsigned char>(*current++) : -1;
+    }
+
+    void skipWhitespace()
+    {
+        while (current < end && isJsonWhitespace(*current))
+            ++current;
+    }
+
+    bool consume(char expected)
+    {
+        skipWhitespace();
+        if (current < end && *current == expected)
+        {
+            ++current;
+            return true;
+        }
+        return false;
+    }
+
+    bool consumeLiteral(const char* literal, size_t length)
+    {
+        if (static_cast<size_t>(end - current) < length || memcmp(current, literal, length) != 0)
+            return false;
+        current += length;
+        return true;
+    }
+
+    // Leaves the characters of the string in text, or its position in the source when it has no escapes
+    bool parseString(std::string& text, bool& escaped, const char*& start)
+    {
+        start = current;
+        escaped = false;
+
+        for (;;)
+        {
+            const char* special = findStringSpecial(current, end);
+            if (escaped)
+                text.append(current, special - current);
+            current = special;
+
+            if (current == end) return false;
+
+            const char c = *current++;
+            if (c == '"') return true;
+            if (c != '\\') return false; // Control characters have to be escaped
+
+            if (!escaped)
+            {
+                // First escape, everything up to here is copied and the rest is decoded
+                escaped = true;
+                text.assign(start, current - 1 - start);
+            }
+            if (!readEscape(*this, text)) return false;
+        }
+    }
+
+    ObjString* parseStringValue(bool isKey)
+    {
+        bool escaped;
+        const char* start;
+        if (!parseString(scratch, escaped, start)) return nullptr;
+
+        if (escaped)
+            return takeString(scratch.data(), static_cast<int>(scratch.length()));
+
+        const int length = static_cast<int>(current - 1 - start);
+
+        // Keys are looked up all the time, so they are always interned copies
+        if (isKey)
+            return copyString(start, length);
+        return sliceString(source, static_cast<int>(start - begin), length);
+    }
+
+    bool parseValue(Value* result, int depth)
+    {
+        if (depth > JSON_MAX_DEPTH) return false;
+
+        skipWhitespace();
+        if (current == end) return false;
+
+        switch (*current)
+        {
+        case '{': ++current; return parseObject(result, depth);
+        case '[': ++current; return parseArray(result, depth);
+        case '"':
+        {
+            ++current;
+            ObjString* string = parseStringValue(false);
+            if (string == nullptr) return false;
+            *result = Value(string);
+            return true;
+        }
+        case 't':
+            *result = Value(true);
+            return consumeLiteral("true", 4);
+        case 'f':
+            *result = Value(false);
+            return consumeLiteral("false", 5);
+        case 'n':
+            *result = Value();
+            return consumeLiteral("null", 4);
+        default:
+        {
+            const size_t length = numberLength(current, end);
+            if (length == 0) return false;
+
+            const double number = convertNumber(current, current + length);
+            current += length;
+            *result = Value(number);
+            return true;
+        }
+        }
+    }
+
+    bool parseArray(Value* result, int depth)
+    {
+        ObjList* list = newList();
+        open->append(Value(list));
+
+        if (!consume(']'))
+        {
+            do
+            {
+                Value element;
+                if (!parseValue(&element, depth + 1)) return false;
+                list->append(element);
+            } while (consume(','));
+
+            if (!consume(']')) return false;
+        }
+
+        open->items.pop_back();
+        *result = Value(list);
+        return true;
+    }
+
+    bool parseObject(Value* result, int depth)
+    {
+        ObjMap* map = newMap();
+        open->append(Value(map));
+
+        if (!consume('}'))
+        {
+            do
+            {
+                if (!consume('"')) return false;
+                ObjString* key = parseStringValue(true);
+                if (key == nullptr) return false;
+                open->append(Value(key));
+
+                Value element;
+                if (!consume(':') || !parseValue(&element, depth + 1)) return false;
+                map->table.set(Value(key), element);
+                open->items.pop_back();
+            } while (consume(','));
+
+            if (!consume('}')) return false;
+        }
+
+        open->items.pop_back();
+        *result = Value(map);
+        return true;
+    }
+
+    ObjString* source;
+    const char* begin;
+    const char* current;
+    const char* end;
+    ObjList* open;
+    std::string scratch;
+};
+
+bool jsonParse(ObjString* source, Value* result)
+{
+    VM* vm = &VM::getInstance();
+
+    ObjList* open = newList();
+    vm->push(Value(open));
+
+    JsonParser parser(source, open);
+    bool valid = parser.parseValue(result, 0);
+
+    // Nothing but whitespace can follow the document
+    parser.skipWhitespace();
+    valid = valid && parser.current == parser.end;
+
+    vm->pop();
+    return valid;
+}
+
+static void appendJsonString(std::string& out, std::string_view text)
+{
+    static const char* hex = "0123456789abcdef";
+
+    out += '"';
+    const char* current = text.data();
+    const char* end = current + text.length();
+    for (;;)
+    {
+        const char* special = findStringSpecial(current, end);
+        out.append(current, special - current);
+        if (special == end) break;
+
+        const char c = *special;
+        switch (c)
+        {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            out += "\\u00";
+            out += hex[(c >> 4) & 0xF];
+            out += hex[c & 0xF];
+            break;
+        }
+        current = special + 1;
+    }
+    out += '"';
+}
+
+static void appendJsonNumber(std::string& out, double number)
+{
+    // JSON has no infinity or NaN
+    if (!std::isfinite(number))
+    {
+        out += "null";
+        return;
+    }
+    appendNumber(out, number);
+}
+
+static void appendJsonKey(std::string& out, const Value& key)
+{
+    if (isString(key))
+    {
+        appendJsonString(out, asString(key)->view());
+        return;
+    }
+
+    // JSON keys are always strings
+    std::string text;
+    appendValue(text, key);
+    appendJsonString(out, text);
+}
+
+static bool stringify(std::string& out, const Value& value, int depth)
+{
+    if (depth > JSON_MAX_DEPTH) return false;
+
+    switch (value.type)
+    {
+    case ValueType::BOOL: out += asBoolean(value) ? "true" : "false"; return true;
+    case ValueType::NIL: out += "null"; return true;
+    case ValueType::NUMBER: appendJsonNumber(out, asNumber(value)); return true;
+    case ValueType::OBJ: break;
+    }
+
+    switch (getObjType(value))
+    {
+    case ObjType::STRING:
+        appendJsonString(out, asString(value)->view());
+        return true;
+    case ObjType::LIST:
+    {
+        out += '[';
+        const std::vector<Value>& items = asList(value)->items;
+        for (size_t i = 0; i < items.size(); ++i)
+        {
+            if (i > 0) out += ',';
+            if (!stringify(out, items[i], depth + 1)) return false;
+        }
+        out += ']';
+        return true;
+    }
+    case ObjType::FLOAT_ARRAY:
+    {
+        out += '[';
+        const std::vector<double>& items = asFloatArray(value)->items;
+        for (size_t i = 0; i < items.size(); ++i)
+        {
+            if (i > 0) out += ',';
+            appendJsonNumber(out, items[i]);
+        }
+        out += ']';
+        return true;
+    }
+    case ObjType::SET:
+    {
+        out += '[';
+        const ValueTable& table = asSet(value)->table;
+        for (size_t i = 0; i < table.count(); ++i)
+        {
+            if (i > 0) out += ',';
+            if (!stringify(out, table.entryAt(i).key, depth + 1)) return false;
+        }
+        out += ']';
+        return true;
+    }
+    case ObjType::MAP:
+    {
+        out += '{';
+        const ValueTable& table = asMap(value)->table;
+        for (size_t i = 0; i < table.count(); ++i)
+        {
+            if (i > 0) out += ',';
+            appendJsonKey(out, table.entryAt(i).key);
+            out += ':';
+            if (!stringify(out, table.entryAt(i).value, depth + 1)) return false;
+        }
+        out += '}';
+        return true;
+    }
+    case ObjType::INSTANCE:
+    {
+        out += '{';
+        bool first = true;
+        bool valid = true;
+        asInstance(value)->fields.forEach([&](ObjString* key, const Value& field)
+        {
+            if (!first) out += ',';
+            first = false;
+            appendJsonString(out, key->view());
+            out += ':';
+            valid = valid && stringify(out, field, depth + 1);
+        });
+        out += '}';
+        return valid;
+    }
+    default:
+        // Functions, classes, iterators, files...
+        out += "null";
+        return true;
+    }
+}
+
+bool jsonStringify(std::string& out, const Value& value)
+{
+    return stringify(out, value, 0);
+}
+
+Value jsonEventToValue(const JsonEvent& event)
+{
+    static const char* names[] =
+    {
+        "startObject",
+        "endObject",
+        "startArray",
+        "endArray",
+        "key",
+        "value",
+        "value",
+        "value",
+        "value",
+        "error"
+    };
+    static_assert(std::size(names) == static_cast<size_t>(JsonEventType::ERROR) + 1, "Missing event name");
+
+    VM* vm = &VM::getInstance();
+
+    ObjList* list = newList();
+    vm->push(Value(list));
+
+    const char* name = names[static_cast<size_t>(event.type)];
+    list->append(Value(copyString(name, static_cast<int>(strlen(name)))));
+
+    switch (event.type)
+    {
+    case JsonEventType::KEY:
+        list->append(Value(copyString(event.text.data(), static_cast<int>(event.text.length()))));
+        break;
+    case JsonEventType::STRING:
+    case JsonEventType::ERROR:
+        list->append(Value(takeString(event.text.data(), static_cast<int>(event.text.length()))));
+        break;
+    case JsonEventType::NUMBER: list->append(Value(event.number)); break;
+    case JsonEventType::BOOL: list->append(Value(event.boolean)); break;
+    default: list->append(Value()); break;
+    }
+
+    vm->pop();
+    return Value(list);
+}
+
+bool JsonEventReader::open(const char* path)
+{
+    close();
+
+    file = fopen(path, "rb");
+    if (file == nullptr) return false;
+
+    // The reader does its own buffering
+    setvbuf(file, nullptr, _IONBF, 0);
+    buffer.resize(JSON_BUFFER_SIZE);
+    return true;
+}
+
+void JsonEventReader::close()
+{
+    if (file != nullptr)
+    {
+        fclose(file);
+    }
+    file = nullptr;
+    start = 0;
+    end = 0;
+    containers.clear();
+    state = State::VALUE;
+}
+
+bool JsonEventReader::fill()
+{
+    if (file == nullptr) return false;
+
+    start = 0;
+    end = fread(buffer.data(), 1, buffer.size(), file);
+    return end > 0;
+}
+
+int JsonEventReader::peek()
+{
+    if (start == end && !fill()) return -1;
+    return static_cast<unsigned char>(buffer[start]);
+}
+
+int JsonEventReader::get()
+{
+    if (start == end && !fill()) return -1;
+    return static_cast<unsigned char>(buffer[start++]);
+}
+
+void JsonEventReader::skipWhitespace()
+{
+    while (isJsonWhitespace(peek()))
+        ++start;
+}
+
+bool JsonEventReader::readString(std::string& text)
+{
+    text.clear();
+
+    for (;;)
+    {
+        if (start == end && !fill()) return false;
+
+        const char* current = buffer.data() + start;
+        const char* special = findStringSpecial(current, buffer.data() + end);
+        text.append(current, special - current);
+        start += special - current;
+
+        // The string continues in the next block of the file
+        if (start == end) continue;
+
+        const char c = buffer[start++];
+        if (c == '"') return true;
+        if (c != '\\') return false; // Control characters have to be escaped
+        if (!readEscape(*this, text)) return false;
+    }
+}
+
+bool JsonEventReader::readNumber(double& number)
+{
+    scratch.clear();
+    for (int c = peek(); (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E'; c = peek())
+    {
+        scratch += static_cast<char>(c);
+        ++start;
+    }
+
+    const char* first = scratch.data();
+    const char* last = first + scratch.length();
+    // An empty token has a length of 0 too, a value was missing
+    if (scratch.empty() || numberLength(first, last) != scratch.length()) return false;
+
+    number = convertNumber(first, last);
+    return true;
+}
+
+bool JsonEventReader::readLiteral(const char* literal)
+{
+    for (; *literal != '\0'; ++literal)
+    {
+        if (get() != *literal) return false;
+    }
+    return true;
+}
+
+bool JsonEventReader::fail(JsonEvent& event, const char* message)
+{
+    event.type = JsonEventType::ERROR;
+    event.text = message;
+    state = State::DONE;
+    return true;
+}
+
+bool JsonEventReader::readValue(JsonEvent& event)
+{
+    state = State::AFTER_VALUE;
+
+    switch (peek())
+    {
+    case '{':
+        ++start;
+        containers.push_back('{');
+        event.type = JsonEventType::START_OBJECT;
+        state = State::FIRST_KEY;
+        return true;
+    case '[':
+        ++start;
+        containers.push_back('[');
+        event.type = JsonEventType::START_ARRAY;
+        state = State::FIRST_VALUE;
+        return true;
+    case '"':
+        ++start;
+        event.type = JsonEventType::STRING;
+        return readString(event.text) || fail(event, "Invalid string.");
+    case 't':
+        event.type = JsonEventType::BOOL;
+        event.boolean = true;
+        return readLiteral("true") || fail(event, "Invalid literal.");
+    case 'f':
+        event.type = JsonEventType::BOOL;
+        event.boolean = false;
+        return readLiteral("false") || fail(event, "Invalid literal.");
+    case 'n':
+        event.type = JsonEventType::NULL_VALUE;
+        return readLiteral("null") || fail(event, "Invalid literal.");
+    case -1:
+        return fail(event, "Unexpected end of file.");
+    default:
+        event.type = JsonEventType::NUMBER;
+        return readNumber(event.number) || fail(event, scratch.empty() ? "Expected a value." : "Invalid number.");
+    }
+}
+
+bool JsonEventReader::next(JsonEvent& event)
+{
+    if (file == nullptr) return false;
+
+    skipWhitespace();
+
+    switch (state)
+    {
+    case State::DONE:
+        return false;
+    case State::FIRST_VALUE:
+        if (peek() == ']')
+        {
+            ++start;
+            containers.pop_back();
+            event.type = JsonEventType::END_ARRAY;
+            state = State::AFTER_VALUE;
+            return true;
+        }
+        return readValue(event);
+    case State::VALUE:
+        return readValue(event);
+    case State::FIRST_KEY:
+        if (peek() == '}')
+        {
+            ++start;
+            containers.pop_back();
+            event.type = JsonEventType::END_OBJECT;
+            state = State::AFTER_VALUE;
+            return true;
+        }
+        [[fallthrough]];
+    case State::KEY:
+        if (get() != '"' || !readString(event.text)) return fail(event, "Expected a key.");
+        skipWhitespace();
+        if (get() != ':') return fail(event, "Expected ':' after a key.");
+        event.type = JsonEventType::KEY;
+        state = State::VALUE;
+        return true;
+    case State::AFTER_VALUE:
+    {
+        if (containers.empty())
+        {
+            // Nothing but whitespace can follow the document
+            const bool trailing = peek() != -1;
+            state = State::DONE;
+            return trailing && fail(event, "Unexpected characters after the document.");
+        }
+
+        const char container = containers.back();
+        const int c = get();
+        if (c == ',')
+        {
+            state = container == '{' ? State::KEY : State::VALUE;
+            return next(event);
+        }
+        if (c == (container == '{' ? '}' : ']'))
+        {
+            containers.pop_back();
+            event.type = container == '{' ? JsonEventType::END_OBJECT : JsonEventType::END_ARRAY;
+            return true;
+        }
+        return fail(event, container == '{' ? "Expected ',' or '}'." : "Expected ',' or ']'.");
+    }
+    }
+
+    return false;
+}
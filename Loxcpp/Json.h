@@ -0,0 +1,100 @@
+#ifndef loxcpp_json_h
+#define loxcpp_json_h
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Value.h"
+
+struct ObjString;
+
+// Parses a whole JSON document in a single pass. Objects become maps, arrays lists and null nil.
+// Long strings without escapes are slices of the source instead of copies.
+// Returns false if the source isn't valid JSON.
+bool jsonParse(ObjString* source, Value* result);
+
+// Appends the value as JSON. Lists, float arrays and sets become arrays, maps and instances objects.
+// Returns false if the value nests too deep, which is also what happens with cycles.
+bool jsonStringify(std::string& out, const Value& value);
+
+enum class JsonEventType : uint8_t
+{
+    START_OBJECT,
+    END_OBJECT,
+    START_ARRAY,
+    END_ARRAY,
+    KEY,
+    STRING,
+    NUMBER,
+    BOOL,
+    NULL_VALUE,
+    ERROR
+};
+
+struct JsonEvent
+{
+    JsonEventType type = JsonEventType::NULL_VALUE;
+    std::string text; // Key, string value or error message
+    double number = 0.0;
+    bool boolean = false;
+};
+
+// Event as a list of its name and its value, like ["key", "name"] or ["endArray", nil]
+Value jsonEventToValue(const JsonEvent& event);
+
+// Reads a JSON file one token at a time through a fixed size buffer, without building the document,
+// so files bigger than the memory can be processed. Nesting doesn't use the native stack either.
+class JsonEventReader
+{
+public:
+
+    JsonEventReader() = default;
+    JsonEventReader(const JsonEventReader&) = delete;
+    JsonEventReader& operator=(const JsonEventReader&) = delete;
+
+    ~JsonEventReader()
+    {
+        close();
+    }
+
+    bool open(const char* path);
+    void close();
+
+    // Returns false after the end of the document. Invalid JSON produces a single ERROR event.
+    bool next(JsonEvent& event);
+
+    // Used by the escape decoding shared with the in memory parser
+    int get();
+
+private:
+
+    enum class State : uint8_t
+    {
+        FIRST_VALUE, // After '[', the array can still be empty
+        VALUE,
+        FIRST_KEY,   // After '{', the object can still be empty
+        KEY,
+        AFTER_VALUE,
+        DONE
+    };
+
+    bool fill();
+    int peek();
+    void skipWhitespace();
+    bool readValue(JsonEvent& event);
+    bool readString(std::string& text);
+    bool readNumber(double& number);
+    bool readLiteral(const char* literal);
+    bool fail(JsonEvent& event, const char* message);
+
+    FILE* file = nullptr;
+    std::vector<char> buffer;
+    size_t start = 0;
+    size_t end = 0;
+    std::vector<char> containers; // '{' or '[' for every object or array that is open
+    State state = State::VALUE;
+    std::string scratch;
+};
+
+#endif
@@ -3,8 +3,10 @@
 #include <sstream>
 #include <string>
 
+#include "Benchmark.h"
 #include "Chunk.h"
 #include "Debug.h"
+#include "Profiler.h"
 #include "Vm.h"
 
 void repl()
@@ -22,7 +24,8 @@ void repl()
     }
 }
 
-void runFile(const std::string& path)
+// Folded stacks are written to profilePath when it's set, and the calls are reported on stderr with profileCalls
+void runFile(const std::string& path, const char* profilePath = nullptr, bool profileCalls = false)
 {
     std::ifstream fileStream(path.data());
     if (fileStream.fail())
@@ -34,8 +37,37 @@ void runFile(const std::string& path)
     buffer << fileStream.rdbuf();
     fileStream.close();
 
+    SamplingProfiler profiler;
+    if (profilePath != nullptr)
+    {
+        VM::getInstance().setProfiler(&profiler);
+        profiler.start();
+    }
+
+    CallProfiler callProfiler;
+    if (profileCalls)
+    {
+        VM::getInstance().setCallProfiler(&callProfiler);
+    }
+
     const InterpretResult result = VM::getInstance().interpret(buffer.str());
 
+    if (profilePath != nullptr)
+    {
+        profiler.stop();
+        VM::getInstance().setProfiler(nullptr);
+        if (!profiler.writeFolded(profilePath))
+        {
+            std::cerr << "Could not write profile " << profilePath << "." << std::endl;
+        }
+    }
+
+    if (profileCalls)
+    {
+        VM::getInstance().setCallProfiler(nullptr);
+        callProfiler.report(std::cerr);
+    }
+
     if(result == InterpretResult::INTERPRET_COMPILE_ERROR) exit(65);
     if (result == InterpretResult::INTERPRET_RUNTIME_ERROR) exit(70);
 }
@@ -46,14 +78,35 @@ int main(int argc, const char* argv[])
     {
         repl();
     }
+    else if (argc == 2 && std::string(argv[1]) == "--bench-tables")
+    {
+        benchmarkTables();
+    }
     else if (argc == 2)
     {
         runFile(argv[1]);
         repl();
     }
+    else if (argc == 3 && std::string(argv[1]) == "--profile-calls")
+    {
+        runFile(argv[2], nullptr, true);
+    }
+    else if (argc == 3 && std::string(argv[1]).rfind("--profile", 0) == 0)
+    {
+        // --profile writes to profile.folded, --profile=file to the given file
+        const std::string option = argv[1];
+        if (option != "--profile" && option.rfind("--profile=", 0) != 0)
+        {
+            std::cerr << "Usage: loxcpp [path | --profile[=file] path | --profile-calls path | --bench-tables]" << std::endl;
+            exit(64);
+        }
+
+        const std::string profilePath = option.length() > 10 ? option.substr(10) : "profile.folded";
+        runFile(argv[2], profilePath.c_str());
+    }
     else
     {
-        std::cerr << "Usage: loxcpp [path]" << std::endl;
+        std::cerr << "Usage: loxcpp [path | --profile[=file] path | --profile-calls path | --bench-tables]" << std::endl;
         exit(64);
     }
 }
\ No newline at end of file
@@ -6,7 +6,10 @@
 #define ALLOCATE(type, count) \
     (type*)reallocate(NULL, 0, sizeof(type) * (count))
 
-void* reallocate(void* pointer, size_t oldSize, size_t newSize)
+#define GROW_CAPACITY(capacity) \
+    ((capacity) < 8 ? 8 : (capacity) * 2)
+
+inline void* reallocate(void* pointer, size_t oldSize, size_t newSize)
 {
     if (newSize == 0)
     {
@@ -4,7 +4,10 @@
 #include <fstream>
 #include <sstream>
 #include <cstdarg>
+#include <algorithm>
 #include <cmath>
+#include <climits>
+#include <new>
 #include <time.h>
 
 #include "Vm.h"
@@ -12,6 +15,10 @@
 #include "Compiler.h"
 #include "Object.h"
 #include "VMUtils.h"
+#include "NumericKernels.h"
+#include "Serialize.h"
+#include "Bytes.h"
+#include "Profiler.h"
 
 Value clock(int argCount, Value* args, VM* vm)
 {
@@ -23,32 +30,93 @@ Value sizeOf(int argCount, Value* args, VM* vm)
     return Value((double)sizeOf(args[0]));
 }
 
+// Sets a field of a map, the value is rooted while the key is allocated
+static void setField(VM* vm, ObjMap* map, const char* key, const Value& value)
+{
+    vm->push(value);
+    map->table.set(Value(copyString(key, static_cast<int>(strlen(key)))), vm->peek(0));
+    vm->pop();
+}
+
+Value profile(int argCount, Value* args, VM* vm)
+{
+    // Only available when the script runs with the call profiler
+    CallProfiler* profiler = vm->getCallProfiler();
+    if (profiler == nullptr)
+    {
+        return Value();
+    }
+
+    const std::vector<CallStats> results = profiler->results();
+
+    ObjList* list = newList();
+    vm->push(Value(list));
+    for (const CallStats& stats : results)
+    {
+        ObjMap* map = newMap();
+        list->append(Value(map));
+
+        setField(vm, map, "name", Value(copyString(stats.name.data(), static_cast<int>(stats.name.length()))));
+        setField(vm, map, "calls", Value(static_cast<double>(stats.calls)));
+        setField(vm, map, "time", Value(stats.time));
+        setField(vm, map, "selfTime", Value(stats.selfTime));
+        setField(vm, map, "allocations", Value(static_cast<double>(stats.allocations)));
+        setField(vm, map, "selfAllocations", Value(static_cast<double>(stats.selfAllocations)));
+    }
+    vm->pop();
+
+    return Value(list);
+}
+
 Value isList(int argCount, Value* args, VM* vm)
 {
     return Value(isList(args[0]));
 }
 
+Value isMap(int argCount, Value* args, VM* vm)
+{
+    return Value(isMap(args[0]));
+}
+
+Value isSet(int argCount, Value* args, VM* vm)
+{
+    return Value(isSet(args[0]));
+}
+
+Value isFloatArray(int argCount, Value* args, VM* vm)
+{
+    return Value(isFloatArray(args[0]));
+}
+
 Value inBounds(int argCount, Value* args, VM* vm)
 {
     if (!isNumber(args[1]))
         return Value();
 
-    const int idx = static_cast<int>(asNumber(args[1]));
+    const int idx = containerIndex(asNumber(args[1]));
 
     if (isRange(args[0]))
     {
         ObjRange* range = asRange(args[0]);
-        return Value(range->isInBounds(idx));
+        return Value(range->isInBounds(rangeIndex(asNumber(args[1]))));
     }
     else if (isList(args[0]))
     {
         ObjList* list = asList(args[0]);
         return Value(list->isInBounds(idx));
     }
+    else if (isFloatArray(args[0]))
+    {
+        return Value(asFloatArray(args[0])->isInBounds(idx));
+    }
+    else if (isBytes(args[0]))
+    {
+        return Value(asBytes(args[0])->isInBounds(idx));
+    }
     else if (isString(args[0]))
     {
         ObjString* str = asString(args[0]);
-        return Value(idx >= 0 && idx < str->chars.length());
+        return Value(idx >= 0 && idx < str->length);
     }
 
     return Value();
@@ -56,22 +124,51 @@ Value inBounds(int argCount, Value* args, VM* vm)
 
 Value readInput(int argCount, Value* args, VM* vm)
 {
+    // Prompts printed before reading have to be visible
+    vm->flushOutput();
+
     std::string line;
     std::getline(std::cin, line);
 
     return Value(takeString(line.c_str(), line.length()));
 }
 
+Value setFlushPolicy(int argCount, Value* args, VM* vm)
+{
+    if (!isString(args[0]))
+    {
+        return Value();
+    }
+
+    const std::string_view policy = asString(args[0])->view();
+    if (policy == "line") vm->setFlushPolicy(FlushPolicy::LINE);
+    else if (policy == "full") vm->setFlushPolicy(FlushPolicy::FULL);
+    else if (policy == "explicit") vm->setFlushPolicy(FlushPolicy::EXPLICIT);
+    else return Value();
+
+    return Value(true);
+}
+
+Value flushOutput(int argCount, Value* args, VM* vm)
+{
+    vm->flushOutput();
+    return Value();
+}
+
 Value readFile(int argCount, Value* args, VM* vm)
 {
     if (isString(args[0]))
     {
         ObjString* fileName = asString(args[0]);
-        std::ifstream fileStream(fileName->chars);
-        std::stringstream buffer;
-        buffer << fileStream.rdbuf();
-        fileStream.close();
-        return Value(takeString(buffer.str().c_str(), buffer.str().length()));
+        MappedFile file;
+        if (file.open(std::string(fileName->view()).c_str()))
+        {
+            // Strings can't be that long, those files have to be read with lines
+            if (file.size() > INT_MAX)
+                return Value();
+
+            return Value(newMappedString(std::move(file)));
+        }
     }
 
     return Value(takeString("", 0));
@@ -84,19 +181,375 @@ Value writeFile(int argCount, Value* args, VM* vm)
         ObjString* fileName = asString(args[0]);
         ObjString* content = asString(args[1]);
 
-        std::ofstream fileStream(fileName->chars.c_str());
-        if (fileStream.is_open())
+        // The content may be a mapping of the same file, which is why it's replaced instead of truncated
+        const std::string_view text = content->view();
+        return Value(writeWholeFile(std::string(fileName->view()).c_str(), text.data(), text.length()));
+    }
+
+    return Value();
+}
+
+Value lines(int argCount, Value* args, VM* vm)
+{
+    if (!isString(args[0]))
+    {
+        return Value();
+    }
+
+    return Value(newLinesIterator(asString(args[0])));
+}
+
+Value openFile(int argCount, Value* args, VM* vm)
+{
+    if (!isString(args[0]) || !isString(args[1]))
+    {
+        return Value();
+    }
+
+    // "w" truncates the file, "a" appends to it
+    const std::string_view mode = asString(args[1])->view();
+    if (mode != "w" && mode != "a")
+    {
+        return Value();
+    }
+
+    ObjFile* file = newFile();
+    if (!file->writer.open(std::string(asString(args[0])->view()).c_str(), mode == "a"))
+    {
+        return Value();
+    }
+
+    return Value(file);
+}
+
+static bool writeValue(ObjFile* file, const Value& value)
+{
+    if (isString(value))
+    {
+        return file->writer.write(asString(value)->chars(), asString(value)->length);
+    }
+    else if (isBytes(value))
+    {
+        ObjBytes* bytes = asBytes(value);
+        return file->writer.write(reinterpret_cast<const char*>(bytes->data()), bytes->length);
+    }
+
+    static std::string text;
+    text.clear();
+    appendValue(text, value);
+    return file->writer.write(text.data(), text.length());
+}
+
+Value write(int argCount, Value* args, VM* vm)
+{
+    if (!isFile(args[0]))
+    {
+        return Value();
+    }
+
+    return Value(writeValue(asFile(args[0]), args[1]));
+}
+
+Value writeLine(int argCount, Value* args, VM* vm)
+{
+    if (!isFile(args[0]))
+    {
+        return Value();
+    }
+
+    ObjFile* file = asFile(args[0]);
+    return Value(writeValue(file, args[1]) && file->writer.write("\n", 1));
+}
+
+Value flush(int argCount, Value* args, VM* vm)
+{
+    if (!isFile(args[0]))
+    {
+        return Value();
+    }
+
+    return Value(asFile(args[0])->writer.flush());
+}
+
+Value closeFile(int argCount, Value* args, VM* vm)
+{
+    if (!isFile(args[0]))
+    {
+        return Value();
+    }
+
+    return Value(asFile(args[0])->writer.close());
+}
+
+Value parseJson(int argCount, Value* args, VM* vm)
+{
+    if (!isString(args[0]))
+    {
+        return Value();
+    }
+
+    Value result;
+    if (!jsonParse(asString(args[0]), &result))
+    {
+        return Value();
+    }
+    return result;
+}
+
+Value stringifyJson(int argCount, Value* args, VM* vm)
+{
+    std::string json;
+    if (!jsonStringify(json, args[0]))
+    {
+        return Value();
+    }
+    return Value(takeString(std::move(json)));
+}
+
+Value jsonEvents(int argCount, Value* args, VM* vm)
+{
+    if (!isString(args[0]))
+    {
+        return Value();
+    }
+
+    return Value(newJsonEventsIterator(asString(args[0])));
+}
+
+// Delimiters are a single character that can't be confused with quoting or line breaks
+static bool isCsvDelimiter(const Value& value)
+{
+    if (!isString(value) || asString(value)->length != 1) return false;
+
+    const char delimiter = asString(value)->chars()[0];
+    return delimiter != '"' && delimiter != '\n' && delimiter != '\r';
+}
+
+Value csvRows(int argCount, Value* args, VM* vm)
+{
+    if (!isString(args[0]) || !isCsvDelimiter(args[1]))
+    {
+        return Value();
+    }
+
+    return Value(newCsvRowsIterator(asString(args[0]), asString(args[1])->chars()[0]));
+}
+
+Value loadCsvColumns(int argCount, Value* args, VM* vm)
+{
+    if (!isString(args[0]) || !isCsvDelimiter(args[1]))
+    {
+        return Value();
+    }
+
+    Value result;
+    if (!csvColumns(std::string(asString(args[0])->view()).c_str(), asString(args[1])->chars()[0], &result))
+    {
+        return Value();
+    }
+    return result;
+}
+
+Value serialize(int argCount, Value* args, VM* vm)
+{
+    std::string encoding;
+    if (!serializeValue(args[0], encoding))
+    {
+        return Value();
+    }
+
+    ObjBytes* bytes = newBytes(encoding.length());
+    std::copy(encoding.begin(), encoding.end(), bytes->data());
+    return Value(bytes);
+}
+
+Value deserialize(int argCount, Value* args, VM* vm)
+{
+    // Bytes made by serialize, or a string with the same content, like a file read with readFile
+    std::string_view encoding;
+    if (isBytes(args[0]))
+    {
+        ObjBytes* bytes = asBytes(args[0]);
+        encoding = std::string_view(reinterpret_cast<const char*>(bytes->data()), bytes->length);
+    }
+    else if (isString(args[0]))
+    {
+        encoding = asString(args[0])->view();
+    }
+    else
+    {
+        return Value();
+    }
+
+    Value result;
+    if (!deserializeValue(encoding, &result))
+    {
+        return Value();
+    }
+    return result;
+}
+
+Value serializeTo(int argCount, Value* args, VM* vm)
+{
+    if (!isFile(args[0]))
+    {
+        return Value();
+    }
+
+    return Value(serializeValue(args[1], asFile(args[0])->writer));
+}
+
+Value bytes(int argCount, Value* args, VM* vm)
+{
+    // Accepts a size, a string, a list of numbers from 0 to 255 or other bytes to copy
+    if (isNumber(args[0]))
+    {
+        const int size = containerSize(asNumber(args[0]));
+        if (size < 0)
+            return Value();
+
+        try
         {
-            fileStream.write(content->chars.c_str(), content->chars.length());
+            return Value(newBytes(static_cast<size_t>(size)));
+        }
+        catch (const std::bad_alloc&)
+        {
+            return Value();
         }
-        fileStream.close();
+    }
+    else if (isString(args[0]))
+    {
+        ObjString* string = asString(args[0]);
+        ObjBytes* bytes = newBytes(string->length);
+        std::copy(string->chars(), string->chars() + string->length, bytes->data());
+        return Value(bytes);
+    }
+    else if (isList(args[0]))
+    {
+        const std::vector<Value>& items = asList(args[0])->items;
+        for (const Value& item : items)
+        {
+            if (!isNumber(item) || asNumber(item) < 0 || asNumber(item) > 255 || asNumber(item) != floor(asNumber(item)))
+                return Value();
+        }
+
+        ObjBytes* bytes = newBytes(items.size());
+        for (size_t idx = 0; idx < items.size(); ++idx)
+        {
+            bytes->data()[idx] = static_cast<uint8_t>(asNumber(items[idx]));
+        }
+        return Value(bytes);
+    }
+    else if (isBytes(args[0]))
+    {
+        ObjBytes* source = asBytes(args[0]);
+        ObjBytes* bytes = newBytes(source->length);
+        std::copy(source->data(), source->data() + source->length, bytes->data());
+        return Value(bytes);
     }
 
     return Value();
 }
 
+Value isBytes(int argCount, Value* args, VM* vm)
+{
+    return Value(isBytes(args[0]));
+}
+
+Value byteLength(int argCount, Value* args, VM* vm)
+{
+    if (!isBytes(args[0]))
+    {
+        return Value();
+    }
+
+    return Value(static_cast<double>(asBytes(args[0])->length));
+}
+
+// Checks the arguments shared by pack and unpack, and that the number fits in the bytes at the offset
+static bool packArguments(Value* args, PackFormat* format, size_t* offset)
+{
+    if (!isBytes(args[0]) || !isNumber(args[1]) || !isString(args[2]))
+        return false;
+
+    if (!parsePackFormat(asString(args[2])->view(), format))
+        return false;
+
+    const double start = asNumber(args[1]);
+    const double length = static_cast<double>(asBytes(args[0])->length);
+    if (start < 0 || start != floor(start) || start + format->size > length)
+        return false;
+
+    *offset = static_cast<size_t>(start);
+    return true;
+}
+
+Value pack(int argCount, Value* args, VM* vm)
+{
+    PackFormat format;
+    size_t offset;
+    if (!packArguments(args, &format, &offset) || !isNumber(args[3]))
+    {
+        return Value();
+    }
+
+    if (!packNumber(asBytes(args[0])->data() + offset, format, asNumber(args[3])))
+    {
+        return Value();
+    }
+
+    // Offset right after the number, to write the next one
+    return Value(static_cast<double>(offset + format.size));
+}
+
+Value unpack(int argCount, Value* args, VM* vm)
+{
+    PackFormat format;
+    size_t offset;
+    if (!packArguments(args, &format, &offset))
+    {
+        return Value();
+    }
+
+    return Value(unpackNumber(asBytes(args[0])->data() + offset, format));
+}
+
+Value readBytes(int argCount, Value* args, VM* vm)
+{
+    if (!isString(args[0]))
+    {
+        return Value();
+    }
+
+    ObjBytes* bytes = readBytesFile(std::string(asString(args[0])->view()).c_str());
+    if (bytes == nullptr)
+    {
+        return Value();
+    }
+    return Value(bytes);
+}
+
+Value writeBytes(int argCount, Value* args, VM* vm)
+{
+    if (!isString(args[0]) || !isBytes(args[1]))
+    {
+        return Value();
+    }
+
+    return Value(writeBytesFile(std::string(asString(args[0])->view()).c_str(), asBytes(args[1])));
+}
+
 Value push(int argCount, Value* args, VM* vm)
 {
+    if (isFloatArray(args[0]))
+    {
+        if (!isNumber(args[1]))
+            return Value();
+
+        ObjFloatArray* array = asFloatArray(args[0]);
+        array->append(asNumber(args[1]));
+        return Value(static_cast<double>(array->items.size()));
+    }
     if (!isList(args[0]))
     {
         return Value();
@@ -109,6 +562,16 @@ Value push(int argCount, Value* args, VM* vm)
 
 Value pop(int argCount, Value* args, VM* vm)
 {
+    if (isFloatArray(args[0]))
+    {
+        ObjFloatArray* array = asFloatArray(args[0]);
+        if (array->items.size() == 0)
+            return Value();
+
+        const double value = array->items.back();
+        array->items.pop_back();
+        return Value(value);
+    }
     if (!isList(args[0]))
     {
         return Value();
@@ -120,7 +583,7 @@ Value pop(int argCount, Value* args, VM* vm)
         return Value();
     }
 
-    Value value = *list->items.end();
+    Value value = list->items.back();
     list->items.pop_back();
     return value;
 }
@@ -135,32 +598,294 @@ Value erase(int argCount, Value* args, VM* vm)
     ObjList* list = asList(args[0]);
     const int index = static_cast<int>(asNumber(args[1]));
 
-    if (index < 0 || index >= list->items.size())
+    if (index < 0 || index >= list->items.size())
+    {
+        return Value();
+    }
+
+    list->deleteValue(index);
+    return Value();
+}
+
+Value concat(int argCount, Value* args, VM* vm)
+{
+    if (!isList(args[0]) || !isList(args[1]))
+    {
+        return Value();
+    }
+
+    ObjList* left = asList(args[0]);
+    ObjList* right = asList(args[1]);
+
+    ObjList* concat = newList();
+
+    concat->items.reserve(left->items.size() + right->items.size());
+    std::copy(left->items.begin(), left->items.end(), std::back_inserter(concat->items));
+    std::copy(right->items.begin(), right->items.end(), std::back_inserter(concat->items));
+
+    return Value(concat);
+}
+
+Value float64Array(int argCount, Value* args, VM* vm)
+{
+    // Accepts a size, a list of numbers or a range
+    if (isNumber(args[0]))
+    {
+        const int size = containerSize(asNumber(args[0]));
+        if (size < 0)
+            return Value();
+
+        ObjFloatArray* array = newFloatArray();
+        try
+        {
+            array->items.resize(static_cast<size_t>(size), 0.0);
+        }
+        catch (const std::bad_alloc&)
+        {
+            return Value();
+        }
+        return Value(array);
+    }
+    else if (isList(args[0]))
+    {
+        const std::vector<Value>& items = asList(args[0])->items;
+        for (const Value& item : items)
+        {
+            if (!isNumber(item))
+                return Value();
+        }
+
+        ObjFloatArray* array = newFloatArray();
+        array->items.reserve(items.size());
+        for (const Value& item : items)
+        {
+            array->append(asNumber(item));
+        }
+        return Value(array);
+    }
+    else if (isRange(args[0]))
+    {
+        ObjRange* range = asRange(args[0]);
+        const int size = containerSize(range->count);
+        if (size < 0)
+            return Value();
+
+        ObjFloatArray* array = newFloatArray();
+        try
+        {
+            array->items.resize(static_cast<size_t>(size));
+        }
+        catch (const std::bad_alloc&)
+        {
+            return Value();
+        }
+        for (size_t idx = 0; idx < array->items.size(); ++idx)
+        {
+            array->items[idx] = range->getValue(static_cast<int64_t>(idx));
+        }
+        return Value(array);
+    }
+    else if (isFloatArray(args[0]))
+    {
+        ObjFloatArray* array = newFloatArray();
+        array->items = asFloatArray(args[0])->items;
+        return Value(array);
+    }
+
+    return Value();
+}
+
+Value keys(int argCount, Value* args, VM* vm)
+{
+    if (!isMap(args[0]))
+    {
+        return Value();
+    }
+
+    const ValueTable& table = asMap(args[0])->table;
+
+    ObjList* keyList = newList();
+    keyList->items.reserve(table.count());
+    for (size_t idx = 0; idx < table.count(); ++idx)
+    {
+        keyList->append(table.entryAt(idx).key);
+    }
+
+    return Value(keyList);
+}
+
+Value values(int argCount, Value* args, VM* vm)
+{
+    if (!isMap(args[0]))
+    {
+        return Value();
+    }
+
+    const ValueTable& table = asMap(args[0])->table;
+
+    ObjList* valueList = newList();
+    valueList->items.reserve(table.count());
+    for (size_t idx = 0; idx < table.count(); ++idx)
+    {
+        valueList->append(table.entryAt(idx).value);
+    }
+
+    return Value(valueList);
+}
+
+Value has(int argCount, Value* args, VM* vm)
+{
+    if (isMap(args[0]))
+    {
+        return Value(asMap(args[0])->table.contains(args[1]));
+    }
+    else if (isSet(args[0]))
+    {
+        return Value(asSet(args[0])->table.contains(args[1]));
+    }
+
+    return Value();
+}
+
+Value remove(int argCount, Value* args, VM* vm)
+{
+    if (isMap(args[0]))
+    {
+        return Value(asMap(args[0])->table.remove(args[1]));
+    }
+    else if (isSet(args[0]))
+    {
+        return Value(asSet(args[0])->table.remove(args[1]));
+    }
+
+    return Value();
+}
+
+Value set(int argCount, Value* args, VM* vm)
+{
+    if (!isIterable(args[0]))
+    {
+        return Value();
+    }
+
+    ObjSet* result = newSet();
+
+    vm->push(Value(result)); // Lazy iterators may run code that triggers the GC
+    forEachIterable(args[0], [&](const Value& element, int64_t idx)
+    {
+        result->table.set(tableKey(element), Value());
+        return true;
+    });
+    vm->pop();
+
+    return Value(result);
+}
+
+Value add(int argCount, Value* args, VM* vm)
+{
+    if (!isSet(args[0]))
+    {
+        return Value();
+    }
+
+    // Returns if the value was not in the set yet
+    return Value(asSet(args[0])->table.set(tableKey(args[1]), Value()));
+}
+
+Value setUnion(int argCount, Value* args, VM* vm)
+{
+    if (!isSet(args[0]) || !isIterable(args[1]))
+    {
+        return Value();
+    }
+
+    ObjSet* result = newSet();
+    result->table = asSet(args[0])->table;
+
+    vm->push(Value(result));
+    forEachIterable(args[1], [&](const Value& element, int64_t idx)
+    {
+        result->table.set(tableKey(element), Value());
+        return true;
+    });
+    vm->pop();
+
+    return Value(result);
+}
+
+Value setIntersection(int argCount, Value* args, VM* vm)
+{
+    if (!isSet(args[0]) || !isIterable(args[1]))
+    {
+        return Value();
+    }
+
+    ObjSet* result = newSet();
+
+    if (isSet(args[1]))
+    {
+        // Walk the smaller set and probe the bigger one
+        const ValueTable* smaller = &asSet(args[0])->table;
+        const ValueTable* bigger = &asSet(args[1])->table;
+        if (smaller->count() > bigger->count())
+            std::swap(smaller, bigger);
+
+        for (size_t idx = 0; idx < smaller->count(); ++idx)
+        {
+            const Value& element = smaller->entryAt(idx).key;
+            if (bigger->contains(element))
+                result->table.set(element, Value());
+        }
+        return Value(result);
+    }
+
+    const ValueTable& table = asSet(args[0])->table;
+
+    vm->push(Value(result));
+    forEachIterable(args[1], [&](const Value& element, int64_t idx)
     {
-        return Value();
-    }
+        if (table.contains(element))
+            result->table.set(tableKey(element), Value());
+        return true;
+    });
+    vm->pop();
 
-    list->deleteValue(index);
-    return Value();
+    return Value(result);
 }
 
-Value concat(int argCount, Value* args, VM* vm)
+Value setDifference(int argCount, Value* args, VM* vm)
 {
-    if (!isList(args[0]) || !isList(args[1]))
+    if (!isSet(args[0]) || !isIterable(args[1]))
     {
         return Value();
     }
 
-    ObjList* left = asList(args[0]);
-    ObjList* right = asList(args[1]);
+    ObjSet* result = newSet();
 
-    ObjList* concat = newList();
+    if (isSet(args[1]))
+    {
+        const ValueTable& table = asSet(args[0])->table;
+        const ValueTable& other = asSet(args[1])->table;
+        for (size_t idx = 0; idx < table.count(); ++idx)
+        {
+            const Value& element = table.entryAt(idx).key;
+            if (!other.contains(element))
+                result->table.set(element, Value());
+        }
+        return Value(result);
+    }
 
-    concat->items.reserve(left->items.size() + right->items.size());
-    std::copy(left->items.begin(), left->items.end(), std::back_inserter(concat->items));
-    std::copy(right->items.begin(), right->items.end(), std::back_inserter(concat->items));
+    result->table = asSet(args[0])->table;
 
-    return Value(concat);
+    vm->push(Value(result));
+    forEachIterable(args[1], [&](const Value& element, int64_t idx)
+    {
+        result->table.remove(element);
+        return true;
+    });
+    vm->pop();
+
+    return Value(result);
 }
 
 Value contains(int argCount, Value* args, VM* vm)
@@ -170,18 +895,21 @@ Value contains(int argCount, Value* args, VM* vm)
         return Value();
     }
 
-    if (isRange(args[0]))
+    if (isMap(args[0]))
+    {
+        return Value(asMap(args[0])->table.contains(args[1]));
+    }
+    else if (isSet(args[0]))
+    {
+        return Value(asSet(args[0])->table.contains(args[1]));
+    }
+    else if (isRange(args[0]))
     {
         if (!isNumber(args[1]))
             return Value();
 
         ObjRange* range = asRange(args[0]);
-
-        for (int idx = 0; range->isInBounds(idx); ++idx)
-        {
-            if (asNumber(args[1]) == range->getValue(idx))
-                return Value(false);
-        }
+        return Value(range->indexOf(asNumber(args[1])) >= 0);
     }
     else if (isList(args[0]))
     {
@@ -192,22 +920,40 @@ Value contains(int argCount, Value* args, VM* vm)
                 return Value(true);
         }
     }
+    else if (isFloatArray(args[0]))
+    {
+        if (!isNumber(args[1]))
+            return Value(false);
+
+        const std::vector<double>& items = asFloatArray(args[0])->items;
+        return Value(indexOfKernel(items.data(), items.size(), asNumber(args[1])) >= 0);
+    }
     else if (isString(args[0]))
     {
         if (!isString(args[1]))
             return Value();
 
-        if (asString(args[1])->chars.length() != 1)
+        if (asString(args[1])->length != 1)
             return Value();
 
         ObjString* str = asString(args[0]);
 
-        for (int idx = 0; idx < str->chars.size(); ++idx)
+        for (int idx = 0; idx < str->length; ++idx)
         {
-            if (str->chars[idx] == *asString(args[1])->chars.begin())
+            if (str->chars()[idx] == asString(args[1])->chars()[0])
                 return Value(true);
         }
     }
+    else if (isIterator(args[0]))
+    {
+        bool found = false;
+        forEachIterable(args[0], [&](const Value& element, int64_t idx)
+        {
+            found = element == args[1];
+            return !found;
+        });
+        return Value(found);
+    }
 
     return Value(false);
 }
@@ -225,12 +971,8 @@ Value indexOf(int argCount, Value* args, VM* vm)
             return Value();
 
         ObjRange* range = asRange(args[0]);
-
-        for (int idx = 0; range->isInBounds(idx); ++idx)
-        {
-            if (asNumber(args[1]) == range->getValue(idx))
-                return Value(static_cast<double>(idx));
-        }
+        const double idx = range->indexOf(asNumber(args[1]));
+        return idx >= 0 ? Value(idx) : Value();
     }
     else if (isList(args[0]))
     {
@@ -241,22 +983,46 @@ Value indexOf(int argCount, Value* args, VM* vm)
                 return Value(static_cast<double>(idx));
         }
     }
+    else if (isFloatArray(args[0]))
+    {
+        if (!isNumber(args[1]))
+            return Value();
+
+        const std::vector<double>& items = asFloatArray(args[0])->items;
+        const ptrdiff_t found = indexOfKernel(items.data(), items.size(), asNumber(args[1]));
+        if (found >= 0)
+            return Value(static_cast<double>(found));
+    }
     else if (isString(args[0]))
     {
         if (!isString(args[1]))
             return Value();
 
-        if (asString(args[1])->chars.length() != 1)
+        if (asString(args[1])->length != 1)
             return Value();
 
         ObjString* str = asString(args[0]);
 
-        for (int idx = 0; idx < str->chars.size(); ++idx)
+        for (int idx = 0; idx < str->length; ++idx)
         {
-            if (str->chars[idx] == *asString(args[1])->chars.begin())
+            if (str->chars()[idx] == asString(args[1])->chars()[0])
                 return Value(static_cast<double>(idx));
         }
     }
+    else if (isIterator(args[0]))
+    {
+        Value foundIndex;
+        forEachIterable(args[0], [&](const Value& element, int64_t idx)
+        {
+            if (element == args[1])
+            {
+                foundIndex = Value(static_cast<double>(idx));
+                return false;
+            }
+            return true;
+        });
+        return foundIndex;
+    }
 
     return Value();
 }
@@ -270,7 +1036,7 @@ Value findIf(int argCount, Value* args, VM* vm)
 
     Value foundResult;
 
-    forEachIterable(args[0], [&](const Value& element, int idx)
+    forEachIterable(args[0], [&](const Value& element, int64_t idx)
     {
         if (!isFalsey(callFunction(vm, args[1], element)))
         {
@@ -291,7 +1057,7 @@ Value map(int argCount, Value* args, VM* vm)
     }
     ObjList* mappedList = newList();
 
-    forEachIterable(args[0], [&](const Value& element, int idx)
+    forEachIterable(args[0], [&](const Value& element, int64_t idx)
     {
         mappedList->append(callFunction(vm, args[1], element));
         return true;
@@ -309,7 +1075,7 @@ Value filter(int argCount, Value* args, VM* vm)
 
     ObjList* mappedList = newList();
 
-    forEachIterable(args[0], [&](const Value& element, int idx)
+    forEachIterable(args[0], [&](const Value& element, int64_t idx)
     {
         if (!isFalsey(callFunction(vm, args[1], element)))
         {
@@ -330,7 +1096,7 @@ Value reduce(int argCount, Value* args, VM* vm)
 
     Value accum = args[2];
 
-    forEachIterable(args[0], [&](const Value& element, int idx)
+    forEachIterable(args[0], [&](const Value& element, int64_t idx)
     {
         accum = callFunction(vm, args[1], accum, element);
         return true;
@@ -339,25 +1105,496 @@ Value reduce(int argCount, Value* args, VM* vm)
     return accum;
 }
 
+Value lazyMap(int argCount, Value* args, VM* vm)
+{
+    if (!isIterable(args[0]) || !isCallable(args[1]))
+    {
+        return Value();
+    }
+
+    return Value(newIterator(IteratorKind::MAP, args[0], args[1]));
+}
+
+Value lazyFilter(int argCount, Value* args, VM* vm)
+{
+    if (!isIterable(args[0]) || !isCallable(args[1]))
+    {
+        return Value();
+    }
+
+    return Value(newIterator(IteratorKind::FILTER, args[0], args[1]));
+}
+
+Value take(int argCount, Value* args, VM* vm)
+{
+    if (!isIterable(args[0]) || !isNumber(args[1]))
+    {
+        return Value();
+    }
+
+    return Value(newIterator(IteratorKind::TAKE, args[0], args[1]));
+}
+
+Value zip(int argCount, Value* args, VM* vm)
+{
+    if (!isIterable(args[0]) || !isIterable(args[1]))
+    {
+        return Value();
+    }
+
+    return Value(newIterator(IteratorKind::ZIP, args[0], args[1]));
+}
+
+// Sum of an iterable of numbers. Returns false if any element is not a number.
+static bool sumNumbers(const Value& iterable, double* total, double* count)
+{
+    if (isFloatArray(iterable))
+    {
+        const std::vector<double>& items = asFloatArray(iterable)->items;
+        *total = sumKernel(items.data(), items.size());
+        *count = static_cast<double>(items.size());
+        return true;
+    }
+    else if (isRange(iterable))
+    {
+        ObjRange* range = asRange(iterable);
+        if (!std::isfinite(range->count))
+            return false;
+
+        // Arithmetic series
+        *count = range->count;
+        *total = range->count > 0 ? range->count * (range->min + range->lastValue()) / 2.0 : 0.0;
+        return true;
+    }
+    else if (isList(iterable))
+    {
+        // Lists store tagged values side by side, so they can't be handed to the vector kernels.
+        // Several accumulators still avoid waiting on the previous addition.
+        const std::vector<Value>& items = asList(iterable)->items;
+        double sum[4] = { 0.0, 0.0, 0.0, 0.0 };
+        for (size_t i = 0; i < items.size(); ++i)
+        {
+            if (!isNumber(items[i]))
+                return false;
+            sum[i & 3] += asNumber(items[i]);
+        }
+        *total = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+        *count = static_cast<double>(items.size());
+        return true;
+    }
+    else if (isIterable(iterable))
+    {
+        bool numeric = true;
+        *total = 0.0;
+        *count = 0.0;
+        forEachIterable(iterable, [&](const Value& element, int64_t idx)
+        {
+            numeric = isNumber(element);
+            if (numeric)
+            {
+                *total += asNumber(element);
+                *count += 1.0;
+            }
+            return numeric;
+        });
+        return numeric;
+    }
+
+    return false;
+}
+
+// Smallest or biggest number of an iterable, NaN if any of them is. Returns false if it's empty or any element is not a number.
+static bool extremeNumber(const Value& iterable, bool biggest, double* result)
+{
+    if (isFloatArray(iterable))
+    {
+        const std::vector<double>& items = asFloatArray(iterable)->items;
+        if (items.empty())
+            return false;
+
+        *result = biggest ? maxKernel(items.data(), items.size()) : minKernel(items.data(), items.size());
+        return true;
+    }
+    else if (isRange(iterable))
+    {
+        ObjRange* range = asRange(iterable);
+        if (range->count <= 0)
+            return false;
+
+        // Ranges are sorted, so the extremes are the first and last elements
+        const double first = range->min;
+        const double last = std::isfinite(range->count) ? range->lastValue() : range->max;
+        *result = biggest ? std::max(first, last) : std::min(first, last);
+        return true;
+    }
+
+    bool numeric = true;
+    bool empty = true;
+    forEachIterable(iterable, [&](const Value& element, int64_t idx)
+    {
+        numeric = isNumber(element);
+        if (numeric)
+        {
+            const double number = asNumber(element);
+            if (empty || std::isnan(number) || (biggest ? number > *result : number < *result))
+                *result = number;
+            empty = false;
+        }
+        return numeric;
+    });
+
+    return numeric && !empty;
+}
+
+// Number at an index of a float array, list or range. Returns false if it's not a number.
+static bool numberAt(const Value& source, int idx, double* number)
+{
+    if (isFloatArray(source))
+    {
+        *number = asFloatArray(source)->getValue(idx);
+        return true;
+    }
+    else if (isRange(source))
+    {
+        *number = asRange(source)->getValue(idx);
+        return true;
+    }
+
+    const Value& item = asList(source)->items[idx];
+    *number = isNumber(item) ? asNumber(item) : 0.0;
+    return isNumber(item);
+}
+
+static double numericLength(const Value& source)
+{
+    if (isFloatArray(source))
+        return static_cast<double>(asFloatArray(source)->items.size());
+    else if (isList(source))
+        return static_cast<double>(asList(source)->items.size());
+    else if (isRange(source))
+        return asRange(source)->count;
+    return -1.0;
+}
+
+Value sum(int argCount, Value* args, VM* vm)
+{
+    double total = 0.0;
+    double count = 0.0;
+    if (!sumNumbers(args[0], &total, &count))
+        return Value();
+
+    return Value(total);
+}
+
+Value mean(int argCount, Value* args, VM* vm)
+{
+    double total = 0.0;
+    double count = 0.0;
+    if (!sumNumbers(args[0], &total, &count) || count == 0)
+        return Value();
+
+    return Value(total / count);
+}
+
+Value minimum(int argCount, Value* args, VM* vm)
+{
+    double result = 0.0;
+    if (!isIterable(args[0]) || !extremeNumber(args[0], false, &result))
+        return Value();
+
+    return Value(result);
+}
+
+Value maximum(int argCount, Value* args, VM* vm)
+{
+    double result = 0.0;
+    if (!isIterable(args[0]) || !extremeNumber(args[0], true, &result))
+        return Value();
+
+    return Value(result);
+}
+
+Value dot(int argCount, Value* args, VM* vm)
+{
+    const double length = numericLength(args[0]);
+    if (length < 0 || !std::isfinite(length) || length != numericLength(args[1]))
+        return Value();
+
+    if (isFloatArray(args[0]) && isFloatArray(args[1]))
+    {
+        return Value(dotKernel(asFloatArray(args[0])->items.data(), asFloatArray(args[1])->items.data(), static_cast<size_t>(length)));
+    }
+
+    double total = 0.0;
+    for (int idx = 0; idx < length; ++idx)
+    {
+        double a = 0.0;
+        double b = 0.0;
+        if (!numberAt(args[0], idx, &a) || !numberAt(args[1], idx, &b))
+            return Value();
+
+        total += a * b;
+    }
+
+    return Value(total);
+}
+
+static void appendValue(ObjStringBuilder* builder, const Value& value)
+{
+    if (isString(value))
+    {
+        ObjString* string = asString(value);
+        builder->append(string->chars(), string->length);
+    }
+    else if (isNumber(value))
+    {
+        char buffer[32];
+        builder->append(buffer, formatNumber(asNumber(value), buffer));
+    }
+    else
+    {
+        ObjString* string = valueAsString(value);
+        builder->append(string->chars(), string->length);
+    }
+}
+
+Value stringBuilder(int argCount, Value* args, VM* vm)
+{
+    return Value(newStringBuilder());
+}
+
+Value append(int argCount, Value* args, VM* vm)
+{
+    if (!isStringBuilder(args[0]))
+    {
+        return Value();
+    }
+
+    appendValue(asStringBuilder(args[0]), args[1]);
+    return args[0];
+}
+
+Value toString(int argCount, Value* args, VM* vm)
+{
+    if (isStringBuilder(args[0]))
+    {
+        // The builder's buffer becomes the string, so it's not copied
+        ObjStringBuilder* builder = asStringBuilder(args[0]);
+        const int length = builder->length;
+        return Value(takeBuffer(builder->release(), length));
+    }
+    else if (isString(args[0]))
+    {
+        return args[0];
+    }
+    else if (isBytes(args[0]))
+    {
+        // The raw bytes, to turn text read as bytes back into a string
+        ObjBytes* bytes = asBytes(args[0]);
+        if (bytes->length > INT_MAX)
+            return Value();
+
+        return Value(takeString(reinterpret_cast<const char*>(bytes->data()), static_cast<int>(bytes->length)));
+    }
+    else if (isNumber(args[0]))
+    {
+        char buffer[32];
+        return Value(copyString(buffer, formatNumber(asNumber(args[0]), buffer)));
+    }
+
+    return Value(valueAsString(args[0]));
+}
+
+Value join(int argCount, Value* args, VM* vm)
+{
+    if (!isList(args[0]) || !isString(args[1]))
+    {
+        return Value();
+    }
+
+    const std::vector<Value>& items = asList(args[0])->items;
+    ObjString* separator = asString(args[1]);
+    if (items.empty())
+    {
+        return Value(copyString("", 0));
+    }
+
+    // Measure everything first, so the result is allocated once.
+    // Elements that aren't strings or numbers are converted up front and kept for the second pass.
+    char buffer[32];
+    std::vector<std::string> converted;
+    size_t length = static_cast<size_t>(separator->length) * (items.size() - 1);
+    for (const Value& item : items)
+    {
+        if (isString(item))
+            length += asString(item)->length;
+        else if (isNumber(item))
+            length += formatNumber(asNumber(item), buffer);
+        else
+        {
+            converted.emplace_back(valueAsString(item)->view());
+            length += converted.back().length();
+        }
+    }
+
+    char* chars = static_cast<char*>(malloc(length + 1));
+    size_t offset = 0;
+    size_t convertedIdx = 0;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        if (i > 0)
+        {
+            memcpy(chars + offset, separator->chars(), separator->length);
+            offset += separator->length;
+        }
+
+        const Value& item = items[i];
+        if (isString(item))
+        {
+            memcpy(chars + offset, asString(item)->chars(), asString(item)->length);
+            offset += asString(item)->length;
+        }
+        else if (isNumber(item))
+        {
+            const int count = formatNumber(asNumber(item), buffer);
+            memcpy(chars + offset, buffer, count);
+            offset += count;
+        }
+        else
+        {
+            const std::string& text = converted[convertedIdx++];
+            memcpy(chars + offset, text.data(), text.length());
+            offset += text.length();
+        }
+    }
+    chars[length] = '\0';
+
+    return Value(takeBuffer(chars, static_cast<int>(length)));
+}
+
+Value substr(int argCount, Value* args, VM* vm)
+{
+    if (!isString(args[0]) || !isNumber(args[1]) || !isNumber(args[2]))
+    {
+        return Value();
+    }
+
+    ObjString* string = asString(args[0]);
+    const int start = std::clamp(static_cast<int>(asNumber(args[1])), 0, string->length);
+    const int length = std::clamp(static_cast<int>(asNumber(args[2])), 0, string->length - start);
+
+    return Value(sliceString(string, start, length));
+}
+
+Value split(int argCount, Value* args, VM* vm)
+{
+    if (!isString(args[0]) || !isString(args[1]))
+    {
+        return Value();
+    }
+
+    ObjString* string = asString(args[0]);
+    const std::string_view separator = asString(args[1])->view();
+
+    ObjList* result = newList();
+    vm->push(Value(result));
+
+    if (separator.empty())
+    {
+        // Splitting by nothing gives every character
+        for (int idx = 0; idx < string->length; ++idx)
+        {
+            result->append(Value(vm->characterString(string->chars()[idx])));
+        }
+    }
+    else
+    {
+        // Every field is a slice of the original string, nothing is copied except short fields
+        size_t start = 0;
+        for (;;)
+        {
+            const size_t end = string->view().find(separator, start);
+            const size_t fieldEnd = end == std::string_view::npos ? string->length : end;
+            result->append(Value(sliceString(string, static_cast<int>(start), static_cast<int>(fieldEnd - start))));
+
+            if (end == std::string_view::npos)
+                break;
+            start = end + separator.length();
+        }
+    }
+
+    vm->pop();
+    return Value(result);
+}
+
 void registerNatives(VM* vm)
 {
     vm->defineNative("clock", 1, &clock);
     vm->defineNative("sizeOf", 1, &sizeOf);
+    vm->defineNative("profile", 0, &profile);
 
     // Types
     vm->defineNative("isList", 1, &isList);
+    vm->defineNative("isMap", 1, &isMap);
+    vm->defineNative("isSet", 1, &isSet);
+    vm->defineNative("isFloat64Array", 1, &isFloatArray);
     vm->defineNative("inBounds", 1, &inBounds);
 
     // IO
     vm->defineNative("readInput", 0, &readInput);
+    vm->defineNative("setFlushPolicy", 1, &setFlushPolicy);
+    vm->defineNative("flushOutput", 0, &flushOutput);
     vm->defineNative("readFile", 1, &readFile);
     vm->defineNative("writeFile", 2, &writeFile);
+    vm->defineNative("lines", 1, &lines);
+    vm->defineNative("open", 2, &openFile);
+    vm->defineNative("write", 2, &write);
+    vm->defineNative("writeLine", 2, &writeLine);
+    vm->defineNative("flush", 1, &flush);
+    vm->defineNative("close", 1, &closeFile);
+
+    // JSON
+    vm->defineNative("jsonParse", 1, &parseJson);
+    vm->defineNative("jsonStringify", 1, &stringifyJson);
+    vm->defineNative("jsonEvents", 1, &jsonEvents);
+
+    // CSV
+    vm->defineNative("csvRows", 2, &csvRows);
+    vm->defineNative("csvColumns", 2, &loadCsvColumns);
+
+    // Serialization
+    vm->defineNative("serialize", 1, &serialize);
+    vm->defineNative("deserialize", 1, &deserialize);
+    vm->defineNative("serializeTo", 2, &serializeTo);
+
+    // Bytes
+    vm->defineNative("bytes", 1, &bytes);
+    vm->defineNative("isBytes", 1, &isBytes);
+    vm->defineNative("byteLength", 1, &byteLength);
+    vm->defineNative("pack", 4, &pack);
+    vm->defineNative("unpack", 3, &unpack);
+    vm->defineNative("readBytes", 1, &readBytes);
+    vm->defineNative("writeBytes", 2, &writeBytes);
 
     // Lists
     vm->defineNative("push", 2, &push);
     vm->defineNative("pop", 1, &pop);
     vm->defineNative("erase", 2, &erase);
     vm->defineNative("concat", 2, &concat);
+    vm->defineNative("float64Array", 1, &float64Array);
+
+    // Maps
+    vm->defineNative("keys", 1, &keys);
+    vm->defineNative("values", 1, &values);
+    vm->defineNative("has", 2, &has);
+    vm->defineNative("remove", 2, &remove);
+
+    // Sets
+    vm->defineNative("set", 1, &set);
+    vm->defineNative("add", 2, &add);
+    vm->defineNative("union", 2, &setUnion);
+    vm->defineNative("intersection", 2, &setIntersection);
+    vm->defineNative("difference", 2, &setDifference);
 
     // Iterables
     vm->defineNative("contains", 2, &contains);
@@ -365,5 +1602,26 @@ void registerNatives(VM* vm)
     vm->defineNative("findIf", 2, &findIf);
     vm->defineNative("map", 2, &map);
     vm->defineNative("filter", 2, &filter);
-    vm->defineNative("reduce", 2, &reduce);
+    vm->defineNative("reduce", 3, &reduce);
+
+    // Numeric
+    vm->defineNative("sum", 1, &sum);
+    vm->defineNative("mean", 1, &mean);
+    vm->defineNative("min", 1, &minimum);
+    vm->defineNative("max", 1, &maximum);
+    vm->defineNative("dot", 2, &dot);
+
+    // Strings
+    vm->defineNative("stringBuilder", 0, &stringBuilder);
+    vm->defineNative("append", 2, &append);
+    vm->defineNative("toString", 1, &toString);
+    vm->defineNative("join", 2, &join);
+    vm->defineNative("substr", 3, &substr);
+    vm->defineNative("split", 2, &split);
+
+    // Lazy iterators
+    vm->defineNative("lazyMap", 2, &lazyMap);
+    vm->defineNative("lazyFilter", 2, &lazyFilter);
+    vm->defineNative("take", 2, &take);
+    vm->defineNative("zip", 2, &zip);
 }
\ No newline at end of file
@@ -11,18 +11,57 @@ Value sizeOf(int argCount, Value* args, VM* vm);
 
 // Types
 Value isList(int argCount, Value* args, VM* vm);
+Value isMap(int argCount, Value* args, VM* vm);
+Value isSet(int argCount, Value* args, VM* vm);
+Value isFloatArray(int argCount, Value* args, VM* vm);
 Value inBounds(int argCount, Value* args, VM* vm);
 
 // IO
 Value readInput(int argCount, Value* args, VM* vm);
+Value setFlushPolicy(int argCount, Value* args, VM* vm);
+Value flushOutput(int argCount, Value* args, VM* vm);
 Value readFile(int argCount, Value* args, VM* vm);
 Value writeFile(int argCount, Value* args, VM* vm);
+Value lines(int argCount, Value* args, VM* vm);
+Value openFile(int argCount, Value* args, VM* vm);
+Value write(int argCount, Value* args, VM* vm);
+Value writeLine(int argCount, Value* args, VM* vm);
+Value flush(int argCount, Value* args, VM* vm);
+Value closeFile(int argCount, Value* args, VM* vm);
+
+// JSON
+Value parseJson(int argCount, Value* args, VM* vm);
+Value stringifyJson(int argCount, Value* args, VM* vm);
+Value jsonEvents(int argCount, Value* args, VM* vm);
+
+// CSV
+Value csvRows(int argCount, Value* args, VM* vm);
+Value loadCsvColumns(int argCount, Value* args, VM* vm);
+
+// Serialization
+Value serialize(int argCount, Value* args, VM* vm);
+Value deserialize(int argCount, Value* args, VM* vm);
+Value serializeTo(int argCount, Value* args, VM* vm);
 
 // Lists
 Value push(int argCount, Value* args, VM* vm);
 Value pop(int argCount, Value* args, VM* vm);
 Value erase(int argCount, Value* args, VM* vm);
 Value concat(int argCount, Value* args, VM* vm);
+Value float64Array(int argCount, Value* args, VM* vm);
+
+// Maps
+Value keys(int argCount, Value* args, VM* vm);
+Value values(int argCount, Value* args, VM* vm);
+Value has(int argCount, Value* args, VM* vm);
+Value remove(int argCount, Value* args, VM* vm);
+
+// Sets
+Value set(int argCount, Value* args, VM* vm);
+Value add(int argCount, Value* args, VM* vm);
+Value setUnion(int argCount, Value* args, VM* vm);
+Value setIntersection(int argCount, Value* args, VM* vm);
+Value setDifference(int argCount, Value* args, VM* vm);
 
 // Iterables
 Value contains(int argCount, Value* args, VM* vm);
@@ -32,6 +71,27 @@ Value map(int argCount, Value* args, VM* vm);
 Value filter(int argCount, Value* args, VM* vm);
 Value reduce(int argCount, Value* args, VM* vm);
 
+// Numeric
+Value sum(int argCount, Value* args, VM* vm);
+Value mean(int argCount, Value* args, VM* vm);
+Value minimum(int argCount, Value* args, VM* vm);
+Value maximum(int argCount, Value* args, VM* vm);
+Value dot(int argCount, Value* args, VM* vm);
+
+// Strings
+Value stringBuilder(int argCount, Value* args, VM* vm);
+Value append(int argCount, Value* args, VM* vm);
+Value toString(int argCount, Value* args, VM* vm);
+Value join(int argCount, Value* args, VM* vm);
+Value substr(int argCount, Value* args, VM* vm);
+Value split(int argCount, Value* args, VM* vm);
+
+// Lazy iterators
+Value lazyMap(int argCount, Value* args, VM* vm);
+Value lazyFilter(int argCount, Value* args, VM* vm);
+Value take(int argCount, Value* args, VM* vm);
+Value zip(int argCount, Value* args, VM* vm);
+
 void registerNatives(VM* vm);
 
 #endif
\ No newline at end of file
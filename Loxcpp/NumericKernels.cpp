@@ -0,0 +1,412 @@
+#include "NumericKernels.h"
+
+#include <limits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define LOX_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC lets any function use the intrinsics, GCC and Clang need to be told which functions can
+#if defined(_MSC_VER)
+#define TARGET_SSE2
+#define TARGET_AVX
+#else
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX __attribute__((target("avx")))
+#endif
+
+// Scalar fallbacks. Several accumulators break the dependency between consecutive additions.
+// Min and max are NaN when any element is NaN, like a sum would be, whatever the CPU and wherever the NaN is.
+
+static double sumScalar(const double* data, size_t count)
+{
+    double sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        sum0 += data[i];
+        sum1 += data[i + 1];
+        sum2 += data[i + 2];
+        sum3 += data[i + 3];
+    }
+    for (; i < count; ++i)
+    {
+        sum0 += data[i];
+    }
+    return (sum0 + sum1) + (sum2 + sum3);
+}
+
+static double minScalar(const double* data, size_t count)
+{
+    double result = data[0];
+    for (size_t i = 1; i < count; ++i)
+    {
+        result = data[i] < result || data[i] != data[i] ? data[i] : result;
+    }
+    return result;
+}
+
+static double maxScalar(const double* data, size_t count)
+{
+    double result = data[0];
+    for (size_t i = 1; i < count; ++i)
+    {
+        result = data[i] > result || data[i] != data[i] ? data[i] : result;
+    }
+    return result;
+}
+
+static double dotScalar(const double* a, const double* b, size_t count)
+{
+    double sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        sum0 += a[i] * b[i];
+        sum1 += a[i + 1] * b[i + 1];
+        sum2 += a[i + 2] * b[i + 2];
+        sum3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < count; ++i)
+    {
+        sum0 += a[i] * b[i];
+    }
+    return (sum0 + sum1) + (sum2 + sum3);
+}
+
+static ptrdiff_t indexOfScalar(const double* data, size_t count, double value)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (data[i] == value)
+            return static_cast<ptrdiff_t>(i);
+    }
+    return -1;
+}
+
+#ifdef LOX_KERNELS_X86
+
+// SSE2, 2 doubles per register
+
+TARGET_SSE2 static double horizontalSum(__m128d v)
+{
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+TARGET_SSE2 static double sumSse2(const double* data, size_t count)
+{
+    __m128d sum0 = _mm_setzero_pd();
+    __m128d sum1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        sum0 = _mm_add_pd(sum0, _mm_loadu_pd(data + i));
+        sum1 = _mm_add_pd(sum1, _mm_loadu_pd(data + i + 2));
+    }
+    double sum = horizontalSum(_mm_add_pd(sum0, sum1));
+    for (; i < count; ++i)
+    {
+        sum += data[i];
+    }
+    return sum;
+}
+
+TARGET_SSE2 static double minSse2(const double* data, size_t count)
+{
+    if (count < 2)
+        return minScalar(data, count);
+
+    // _mm_min_pd drops NaNs in its first operand, they are tracked apart
+    __m128d result = _mm_loadu_pd(data);
+    __m128d nan = _mm_cmpunord_pd(result, result);
+    size_t i = 2;
+    for (; i + 2 <= count; i += 2)
+    {
+        const __m128d values = _mm_loadu_pd(data + i);
+        result = _mm_min_pd(result, values);
+        nan = _mm_or_pd(nan, _mm_cmpunord_pd(values, values));
+    }
+    if (_mm_movemask_pd(nan) != 0)
+        return std::numeric_limits<double>::quiet_NaN();
+
+    result = _mm_min_sd(result, _mm_unpackhi_pd(result, result));
+    double min = _mm_cvtsd_f64(result);
+    for (; i < count; ++i)
+    {
+        min = data[i] < min || data[i] != data[i] ? data[i] : min;
+    }
+    return min;
+}
+
+TARGET_SSE2 static double maxSse2(const double* data, size_t count)
+{
+    if (count < 2)
+        return maxScalar(data, count);
+
+    // _mm_max_pd drops NaNs in its first operand, they are tracked apart
+    __m128d result = _mm_loadu_pd(data);
+    __m128d nan = _mm_cmpunord_pd(result, result);
+    size_t i = 2;
+    for (; i + 2 <= count; i += 2)
+    {
+        const __m128d values = _mm_loadu_pd(data + i);
+        result = _mm_max_pd(result, values);
+        nan = _mm_or_pd(nan, _mm_cmpunord_pd(values, values));
+    }
+    if (_mm_movemask_pd(nan) != 0)
+        return std::numeric_limits<double>::quiet_NaN();
+
+    result = _mm_max_sd(result, _mm_unpackhi_pd(result, result));
+    double max = _mm_cvtsd_f64(result);
+    for (; i < count; ++i)
+    {
+        max = data[i] > max || data[i] != data[i] ? data[i] : max;
+    }
+    return max;
+}
+
+TARGET_SSE2 static double dotSse2(const double* a, const double* b, size_t count)
+{
+    __m128d sum0 = _mm_setzero_pd();
+    __m128d sum1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        sum0 = _mm_add_pd(sum0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        sum1 = _mm_add_pd(sum1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+    double sum = horizontalSum(_mm_add_pd(sum0, sum1));
+    for (; i < count; ++i)
+    {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+TARGET_SSE2 static ptrdiff_t indexOfSse2(const double* data, size_t count, double value)
+{
+    const __m128d needle = _mm_set1_pd(value);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        const int mask = _mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(data + i), needle));
+        if (mask != 0)
+            return static_cast<ptrdiff_t>(i + ((mask & 1) ? 0 : 1));
+    }
+    for (; i < count; ++i)
+    {
+        if (data[i] == value)
+            return static_cast<ptrdiff_t>(i);
+    }
+    return -1;
+}
+
+// AVX, 4 doubles per register
+
+TARGET_AVX static double horizontalSumAvx(__m256d v)
+{
+    const __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+}
+
+TARGET_AVX static double sumAvx(const double* data, size_t count)
+{
+    __m256d sum0 = _mm256_setzero_pd();
+    __m256d sum1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        sum0 = _mm256_add_pd(sum0, _mm256_loadu_pd(data + i));
+        sum1 = _mm256_add_pd(sum1, _mm256_loadu_pd(data + i + 4));
+    }
+    double sum = horizontalSumAvx(_mm256_add_pd(sum0, sum1));
+    for (; i < count; ++i)
+    {
+        sum += data[i];
+    }
+    return sum;
+}
+
+TARGET_AVX static double minAvx(const double* data, size_t count)
+{
+    if (count < 4)
+        return minScalar(data, count);
+
+    // _mm256_min_pd drops NaNs in its first operand, they are tracked apart
+    __m256d result = _mm256_loadu_pd(data);
+    __m256d nan = _mm256_cmp_pd(result, result, _CMP_UNORD_Q);
+    size_t i = 4;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m256d values = _mm256_loadu_pd(data + i);
+        result = _mm256_min_pd(result, values);
+        nan = _mm256_or_pd(nan, _mm256_cmp_pd(values, values, _CMP_UNORD_Q));
+    }
+    if (_mm256_movemask_pd(nan) != 0)
+        return std::numeric_limits<double>::quiet_NaN();
+
+    __m128d half = _mm_min_pd(_mm256_castpd256_pd128(result), _mm256_extractf128_pd(result, 1));
+    half = _mm_min_sd(half, _mm_unpackhi_pd(half, half));
+    double min = _mm_cvtsd_f64(half);
+    for (; i < count; ++i)
+    {
+        min = data[i] < min || data[i] != data[i] ? data[i] : min;
+    }
+    return min;
+}
+
+TARGET_AVX static double maxAvx(const double* data, size_t count)
+{
+    if (count < 4)
+        return maxScalar(data, count);
+
+    // _mm256_max_pd drops NaNs in its first operand, they are tracked apart
+    __m256d result = _mm256_loadu_pd(data);
+    __m256d nan = _mm256_cmp_pd(result, result, _CMP_UNORD_Q);
+    size_t i = 4;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m256d values = _mm256_loadu_pd(data + i);
+        result = _mm256_max_pd(result, values);
+        nan = _mm256_or_pd(nan, _mm256_cmp_pd(values, values, _CMP_UNORD_Q));
+    }
+    if (_mm256_movemask_pd(nan) != 0)
+        return std::numeric_limits<double>::quiet_NaN();
+
+    __m128d half = _mm_max_pd(_mm256_castpd256_pd128(result), _mm256_extractf128_pd(result, 1));
+    half = _mm_max_sd(half, _mm_unpackhi_pd(half, half));
+    double max = _mm_cvtsd_f64(half);
+    for (; i < count; ++i)
+    {
+        max = data[i] > max || data[i] != data[i] ? data[i] : max;
+    }
+    return max;
+}
+
+TARGET_AVX static double dotAvx(const double* a, const double* b, size_t count)
+{
+    __m256d sum0 = _mm256_setzero_pd();
+    __m256d sum1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        sum0 = _mm256_add_pd(sum0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        sum1 = _mm256_add_pd(sum1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+    }
+    double sum = horizontalSumAvx(_mm256_add_pd(sum0, sum1));
+    for (; i < count; ++i)
+    {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+TARGET_AVX static ptrdiff_t indexOfAvx(const double* data, size_t count, double value)
+{
+    const __m256d needle = _mm256_set1_pd(value);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const unsigned int mask = static_cast<unsigned int>(_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(data + i), needle, _CMP_EQ_OQ)));
+        if (mask != 0)
+        {
+            size_t lane = 0;
+            while ((mask & (1u << lane)) == 0)
+                ++lane;
+            return static_cast<ptrdiff_t>(i + lane);
+        }
+    }
+    for (; i < count; ++i)
+    {
+        if (data[i] == value)
+            return static_cast<ptrdiff_t>(i);
+    }
+    return -1;
+}
+
+static bool cpuSupportsSse2()
+{
+#if defined(_M_X64) || defined(__x86_64__)
+    return true; // Part of the x64 baseline
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+static bool cpuSupportsAvx()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+
+    // The OS also has to save the upper halves of the ymm registers
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    return osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+#else
+    return __builtin_cpu_supports("avx");
+#endif
+}
+
+#endif
+
+struct Kernels
+{
+    double (*sum)(const double*, size_t);
+    double (*min)(const double*, size_t);
+    double (*max)(const double*, size_t);
+    double (*dot)(const double*, const double*, size_t);
+    ptrdiff_t (*indexOf)(const double*, size_t, double);
+};
+
+static Kernels selectKernels()
+{
+#ifdef LOX_KERNELS_X86
+    if (cpuSupportsAvx())
+        return Kernels{ &sumAvx, &minAvx, &maxAvx, &dotAvx, &indexOfAvx };
+
+    if (cpuSupportsSse2())
+        return Kernels{ &sumSse2, &minSse2, &maxSse2, &dotSse2, &indexOfSse2 };
+#endif
+
+    return Kernels{ &sumScalar, &minScalar, &maxScalar, &dotScalar, &indexOfScalar };
+}
+
+static const Kernels& kernels()
+{
+    static const Kernels selected = selectKernels();
+    return selected;
+}
+
+double sumKernel(const double* data, size_t count)
+{
+    return kernels().sum(data, count);
+}
+
+double minKernel(const double* data, size_t count)
+{
+    return kernels().min(data, count);
+}
+
+double maxKernel(const double* data, size_t count)
+{
+    return kernels().max(data, count);
+}
+
+double dotKernel(const double* a, const double* b, size_t count)
+{
+    return kernels().dot(a, b, count);
+}
+
+ptrdiff_t indexOfKernel(const double* data, size_t count, double value)
+{
+    return kernels().indexOf(data, count, value);
+}
@@ -0,0 +1,18 @@
+#ifndef loxcpp_numeric_kernels_h
+#define loxcpp_numeric_kernels_h
+
+#include <cstddef>
+
+// Reductions and searches over contiguous doubles.
+// They use AVX or SSE2 when the CPU supports them, selected once at startup, and plain loops otherwise.
+// Vectorized sums add the elements in a different order, so results may differ in the last bits from a sequential sum.
+
+double sumKernel(const double* data, size_t count);
+double minKernel(const double* data, size_t count);  // count must be > 0, NaN if any element is NaN
+double maxKernel(const double* data, size_t count);  // count must be > 0, NaN if any element is NaN
+double dotKernel(const double* a, const double* b, size_t count);
+
+// Returns the index of the first element equal to value, or -1
+ptrdiff_t indexOfKernel(const double* data, size_t count, double value);
+
+#endif
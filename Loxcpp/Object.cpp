@@ -1,14 +1,14 @@
 #include "Object.h"
 
 #include <iostream>
+#include <vector>
 
 #include "Memory.h"
 #include "VM.h"
 
-template<class T, class... Args>
-T* allocate(Args&&... args)
+template<class T>
+T* track(T* obj)
 {
-    T* obj = new T(std::forward<Args>(args)...);
 #ifdef DEBUG_LOG_GC
     std::cout << obj << " allocate " << sizeof(*obj) << " for " << objTypeToString(obj->type) << std::endl;
 #endif
@@ -19,6 +19,12 @@ T* allocate(Args&&... args)
     return obj;
 }
 
+template<class T, class... Args>
+T* allocate(Args&&... args)
+{
+    return track(new T(std::forward<Args>(args)...));
+}
+
 
 uint32_t hashString(const char* key, int length)
 {
@@ -31,10 +37,103 @@ uint32_t hashString(const char* key, int length)
     return hash;
 }
 
+// Shorter concatenations are interned like any other string, longer ones build a rope
+#define ROPE_MIN_LENGTH 64
+
+char* ObjString::flatten()
+{
+    ObjRope* rope = static_cast<ObjRope*>(this);
+    if (rope->flat != nullptr) return rope->flat;
+
+    char* flat = static_cast<char*>(malloc(length + 1));
+    flat[length] = '\0';
+
+    // Ropes built in a loop are very deep, so the tree is walked with an explicit stack.
+    // The right piece is visited first, filling the buffer from the end.
+    size_t end = length;
+    std::vector<ObjString*> pending = { rope->left, rope->right };
+    while (!pending.empty())
+    {
+        ObjString* piece = pending.back();
+        pending.pop_back();
+
+        if (piece->kind == StringKind::ROPE && static_cast<ObjRope*>(piece)->flat == nullptr)
+        {
+            pending.push_back(static_cast<ObjRope*>(piece)->left);
+            pending.push_back(static_cast<ObjRope*>(piece)->right);
+            continue;
+        }
+
+        end -= piece->length;
+        memcpy(flat + end, piece->chars(), piece->length);
+    }
+
+    rope->flat = flat;
+    rope->left = nullptr;
+    rope->right = nullptr;
+    return flat;
+}
+
+char* ObjString::sliceChars()
+{
+    ObjSlice* slice = static_cast<ObjSlice*>(this);
+    return slice->parent->chars() + slice->offset;
+}
+
+char* ObjString::mappedChars()
+{
+    // Mapped read only, the VM never writes through it
+    return const_cast<char*>(static_cast<ObjMappedString*>(this)->file.data());
+}
+
+uint32_t stringHash(ObjString* string)
+{
+    // Strings that aren't interned compute it the first time they are hashed
+    if (string->hash == 0 && !string->isInterned())
+    {
+        string->hash = hashString(string->chars(), string->length);
+    }
+    return string->hash;
+}
+
+ObjString* internString(ObjString* string)
+{
+    if (string->isInterned()) return string;
+    return copyString(string->chars(), string->length);
+}
+
+// Shorter slices are copied and interned, they are cheap to copy and don't keep a big parent alive
+#define SLICE_MIN_LENGTH 64
+
+ObjString* sliceString(ObjString* string, int start, int length)
+{
+    if (start == 0 && length == string->length) return string;
+    if (length == 1) return VM::getInstance().characterString(string->chars()[start]);
+    if (length < SLICE_MIN_LENGTH) return copyString(string->chars() + start, length);
+
+    if (string->kind == StringKind::SLICE)
+    {
+        ObjSlice* slice = static_cast<ObjSlice*>(string);
+        start += slice->offset;
+        string = slice->parent;
+    }
+
+    // Makes sure a rope has its own buffer to point into
+    string->chars();
+    return track(new ObjSlice(string, start, length));
+}
+
+Value tableKey(const Value& key)
+{
+    // Slices are copied so a key doesn't keep the whole parent string alive
+    if (isString(key) && asString(key)->kind == StringKind::SLICE)
+        return Value(internString(asString(key)));
+    return key;
+}
+
 ObjString* allocateString(const char* chars, int length, uint32_t hash)
 {
-    // TODO: the std::string allocates memory in the heap out of our control, it can be improved!
-    ObjString* string = allocate<ObjString>(chars, length);
+    ObjString* string = track(new (length) ObjString(chars, length));
     string->hash = hash;
     VM::getInstance().push(Value(string));
     VM::getInstance().stringTable().set(string, Value());
@@ -51,26 +150,80 @@ ObjString* copyString(const char* chars, int length)
     return allocateString(chars, length, hash);
 }
 
+// Longer runtime strings skip the intern table, they are hashed the first time they are used as a key
+#define INTERN_MAX_LENGTH 64
+
+// Smaller files are copied, mapping them costs more than reading them
+#define MAPPED_MIN_SIZE (64 * 1024)
+
+ObjString* newMappedString(MappedFile&& file)
+{
+    if (file.size() < MAPPED_MIN_SIZE)
+    {
+        return takeString(file.data(), static_cast<int>(file.size()));
+    }
+
+    return track(new ObjMappedString(std::move(file)));
+}
+
 ObjString* takeString(const char* chars, int length)
 {
-    const uint32_t hash = hashString(chars, length);
-    ObjString* interned = VM::getInstance().stringTable().findString(chars, length, hash);
-    if (interned != nullptr) return interned;
+    if (length >= INTERN_MAX_LENGTH)
+    {
+        return track(new (length) ObjString(chars, length, StringKind::LONG));
+    }
 
-    return allocateString(chars, length, hash);
+    return copyString(chars, length);
 }
 
 ObjString* takeString(std::string&& chars)
 {
-    const uint32_t hash = hashString(chars.c_str(), chars.length());
-    ObjString* interned = VM::getInstance().stringTable().findString(chars.c_str(), chars.length(), hash);
-    if (interned != nullptr) return interned;
+    // Strings own their characters inline, so they are copied anyway
+    return takeString(chars.c_str(), static_cast<int>(chars.length()));
+}
 
-    ObjString* string = allocate<ObjString>(std::move(chars));
-    string->hash = hash;
+ObjString* takeBuffer(char* chars, int length)
+{
+    // Short strings are interned as usual, longer ones keep the buffer instead of copying it
+    if (length < ROPE_MIN_LENGTH)
+    {
+        ObjString* string = copyString(chars, length);
+        free(chars);
+        return string;
+    }
 
-    VM::getInstance().stringTable().set(string, Value());
-    return string;
+    return track(new ObjRope(chars, length));
+}
+
+void ObjStringBuilder::reserve(int count)
+{
+    if (length + count + 1 <= capacity) return;
+
+    int newCapacity = GROW_CAPACITY(capacity);
+    while (newCapacity < length + count + 1)
+    {
+        newCapacity = GROW_CAPACITY(newCapacity);
+    }
+
+    chars = static_cast<char*>(reallocate(chars, capacity, newCapacity));
+    capacity = newCapacity;
+}
+
+void ObjStringBuilder::append(const char* text, int count)
+{
+    reserve(count);
+    memcpy(chars + length, text, count);
+    length += count;
+    chars[length] = '\0';
+}
+
+char* ObjStringBuilder::release()
+{
+    char* buffer = chars != nullptr ? chars : static_cast<char*>(calloc(1, 1));
+    chars = nullptr;
+    length = 0;
+    capacity = 0;
+    return buffer;
 }
 
 ObjUpvalue* newUpvalue(Value* slot)
@@ -108,9 +261,9 @@ ObjNative* newNative(uint8_t arity, NativeFn function, bool isMethod)
     return allocate<ObjNative>(arity, function, isMethod);
 }
 
-ObjRange* newRange(double min, double max)
+ObjRange* newRange(double min, double max, double step)
 {
-    return allocate<ObjRange>(min, max);
+    return allocate<ObjRange>(min, max, step);
 }
 
 ObjList* newList()
@@ -118,78 +271,263 @@ ObjList* newList()
     return allocate<ObjList>();
 }
 
-void printFunction(ObjFunction* function)
+ObjIterator* newIterator(IteratorKind kind, const Value& source, const Value& argument)
+{
+    return allocate<ObjIterator>(kind, source, argument);
+}
+
+ObjIterator* newLinesIterator(ObjString* path)
+{
+    ObjIterator* iterator = allocate<ObjIterator>(IteratorKind::LINES, Value(path), Value());
+    iterator->reader = std::make_unique<LineReader>();
+    if (!iterator->reader->open(std::string(path->view()).c_str()))
+    {
+        iterator->reader.reset();
+        iterator->exhausted = true;
+    }
+    return iterator;
+}
+
+ObjIterator* newJsonEventsIterator(ObjString* path)
+{
+    ObjIterator* iterator = allocate<ObjIterator>(IteratorKind::JSON_EVENTS, Value(path), Value());
+    iterator->jsonReader = std::make_unique<JsonEventReader>();
+    if (!iterator->jsonReader->open(std::string(path->view()).c_str()))
+    {
+        iterator->jsonReader.reset();
+        iterator->exhausted = true;
+    }
+    return iterator;
+}
+
+ObjIterator* newCsvRowsIterator(ObjString* path, char delimiter)
+{
+    ObjIterator* iterator = allocate<ObjIterator>(IteratorKind::CSV_ROWS, Value(path), Value());
+    iterator->csvReader = std::make_unique<CsvReader>();
+    if (!iterator->csvReader->open(std::string(path->view()).c_str(), delimiter))
+    {
+        iterator->csvReader.reset();
+        iterator->exhausted = true;
+    }
+    return iterator;
+}
+
+ObjMap* newMap()
+{
+    return allocate<ObjMap>();
+}
+
+ObjSet* newSet()
+{
+    return allocate<ObjSet>();
+}
+
+ObjFloatArray* newFloatArray()
+{
+    return allocate<ObjFloatArray>();
+}
+
+ObjStringBuilder* newStringBuilder()
+{
+    return allocate<ObjStringBuilder>();
+}
+
+ObjFile* newFile()
+{
+    return allocate<ObjFile>();
+}
+
+ObjBytes* newBytes(size_t length)
+{
+    return allocate<ObjBytes>(length);
+}
+
+ObjBytes* sliceBytes(ObjBytes* bytes, size_t start, size_t length)
+{
+    // Views always point to the buffer that owns the bytes, so they don't chain
+    if (bytes->parent != nullptr)
+    {
+        start += bytes->offset;
+        bytes = bytes->parent;
+    }
+    return allocate<ObjBytes>(bytes, start, length);
+}
+
+void printFunction(std::string& out, ObjFunction* function)
 {
     if (function->name == nullptr)
     {
-        std::cout << "<script>";
+        out += "<script>";
         return;
     }
-    std::cout << "<fn " << function->name->chars << ">";
+    out += "<fn ";
+    out += function->name->view();
+    out += ">";
 }
 
-void printRange(ObjRange* range)
+std::string rangeAsStr(ObjRange* range)
 {
-    std::cout << range->min << ".." << range->max;
+    std::string str;
+    if (std::isfinite(range->min)) str += std::to_string(range->min);
+    str += "..";
+    if (std::isfinite(range->max)) str += std::to_string(range->max);
+    if (range->step != 1.0) str += " step " + std::to_string(range->step);
+    return str;
 }
 
-void printList(ObjList* list)
+void printRange(std::string& out, ObjRange* range)
 {
-    std::cout << "[";
+    if (std::isfinite(range->min)) appendNumber(out, range->min);
+    out += "..";
+    if (std::isfinite(range->max)) appendNumber(out, range->max);
+    if (range->step != 1.0)
+    {
+        out += " step ";
+        appendNumber(out, range->step);
+    }
+}
+
+void printList(std::string& out, ObjList* list)
+{
+    out += "[";
     const std::vector<Value>& items = list->items;
     for (auto current = items.begin(); current != items.end();)
     {
-        printValue(*current);
+        appendValue(out, *current);
+
+        if (++current != items.end())
+            out += ", ";
+    }
+    out += "]";
+}
+
+void printFloatArray(std::string& out, ObjFloatArray* array)
+{
+    out += "[";
+    const std::vector<double>& items = array->items;
+    for (auto current = items.begin(); current != items.end();)
+    {
+        appendNumber(out, *current);
 
         if (++current != items.end())
-            std::cout << ", ";
+            out += ", ";
+    }
+    out += "]";
+}
+
+void printMap(std::string& out, ObjMap* map)
+{
+    out += "{";
+    const ValueTable& table = map->table;
+    for (size_t i = 0; i < table.count(); ++i)
+    {
+        appendValue(out, table.entryAt(i).key);
+        out += ": ";
+        appendValue(out, table.entryAt(i).value);
+
+        if (i + 1 < table.count())
+            out += ", ";
+    }
+    out += "}";
+}
+
+void printSet(std::string& out, ObjSet* set)
+{
+    out += "{";
+    const ValueTable& table = set->table;
+    for (size_t i = 0; i < table.count(); ++i)
+    {
+        appendValue(out, table.entryAt(i).key);
+
+        if (i + 1 < table.count())
+            out += ", ";
     }
-    std::cout << "]";
+    out += "}";
 }
 
-void printObject(const Value& value)
+void printObject(std::string& out, const Value& value)
 {
     switch (getObjType(value))
     {
     case ObjType::STRING:
-        std::cout << asCString(value);
+        out += asString(value)->view();
         break;
     case ObjType::NATIVE:
-        std::cout << "<native fn>";
+        out += "<native fn>";
         break;
     case ObjType::UPVALUE:
-        printf("upvalue");
+        out += "upvalue";
         break;
     case ObjType::FUNCTION:
-        printFunction(asFunction(value));
+        printFunction(out, asFunction(value));
         break;
     case ObjType::CLOSURE:
-        printFunction(asClosure(value)->function);
+        printFunction(out, asClosure(value)->function);
         break;
     case ObjType::BOUND_METHOD:
-        printObject(asBoundMethod(value)->method);
+        printObject(out, asBoundMethod(value)->method);
         break;
     case ObjType::RANGE:
-        printRange(asRange(value));
+        printRange(out, asRange(value));
         break;
     case ObjType::LIST:
-        printList(asList(value));
+        printList(out, asList(value));
+        break;
+    case ObjType::ITERATOR:
+        out += "<iterator>";
+        break;
+    case ObjType::MAP:
+        printMap(out, asMap(value));
+        break;
+    case ObjType::SET:
+        printSet(out, asSet(value));
+        break;
+    case ObjType::FLOAT_ARRAY:
+        printFloatArray(out, asFloatArray(value));
+        break;
+    case ObjType::STRING_BUILDER:
+        out += "<string builder>";
+        break;
+    case ObjType::FILE:
+        out += "<file>";
+        break;
+    case ObjType::BYTES:
+        out += "<bytes ";
+        appendNumber(out, static_cast<double>(asBytes(value)->length));
+        out += ">";
         break;
     case ObjType::CLASS:
-        std::cout << asClass(value)->name->chars;
+        out += asClass(value)->name->view();
         break;
     case ObjType::INSTANCE:
-        std::cout << asInstance(value)->klass->name->chars << " instance";
+        out += asInstance(value)->klass->name->view();
+        out += " instance";
         break;
     }
-    static_assert(static_cast<int>(ObjType::COUNT) == 10, "Missing enum value");
+    static_assert(static_cast<int>(ObjType::COUNT) == 17, "Missing enum value");
 }
 
 size_t sizeOfObject(const Value& value)
 {
     switch (getObjType(value))
     {
-    case ObjType::STRING: return sizeof(ObjString) + asString(value)->length;
+    case ObjType::STRING:
+    {
+        const ObjString* string = asString(value);
+        switch (string->kind)
+        {
+        case StringKind::FLAT:
+        case StringKind::LONG: return sizeof(ObjString) + string->length;
+        case StringKind::SLICE: return sizeof(ObjSlice);
+        case StringKind::MAPPED: return sizeof(ObjMappedString);
+        case StringKind::ROPE:
+        {
+            const ObjRope* rope = static_cast<const ObjRope*>(string);
+            return sizeof(ObjRope) + (rope->flat != nullptr ? rope->length : 0);
+        }
+        }
+        return sizeof(ObjString);
+    }
     case ObjType::NATIVE: return sizeof(ObjNative);
     case ObjType::UPVALUE: return sizeof(ObjUpvalue) + sizeOf(static_cast<ObjUpvalue*>(asObject(value))->closed);
     case ObjType::FUNCTION:
@@ -222,6 +560,13 @@ size_t sizeOfObject(const Value& value)
         }
         return sizeof(ObjList) + listElemsSize;
     }
+    case ObjType::ITERATOR: return sizeof(ObjIterator);
+    case ObjType::MAP: return sizeof(ObjMap) - sizeof(ValueTable) + asMap(value)->table.getSize();
+    case ObjType::SET: return sizeof(ObjSet) - sizeof(ValueTable) + asSet(value)->table.getSize();
+    case ObjType::FLOAT_ARRAY: return sizeof(ObjFloatArray) + asFloatArray(value)->items.size() * sizeof(double);
+    case ObjType::STRING_BUILDER: return sizeof(ObjStringBuilder) + asStringBuilder(value)->capacity;
+    case ObjType::FILE: return sizeof(ObjFile) + asFile(value)->writer.capacity();
+    case ObjType::BYTES: return sizeof(ObjBytes) + asBytes(value)->storage.size();
     case ObjType::CLASS: 
         return sizeof(ObjClass)
             + asClass(value)->methods.getSize()
@@ -229,50 +574,25 @@ size_t sizeOfObject(const Value& value)
     case ObjType::INSTANCE: return sizeof(ObjInstance) + asInstance(value)->fields.getSize();
     }
 
-    static_assert(static_cast<int>(ObjType::COUNT) == 10, "Missing enum value");
+    static_assert(static_cast<int>(ObjType::COUNT) == 17, "Missing enum value");
     return 0;
 }
 
-std::string objectAsStr(const Value& value)
+ObjString* concatenate(ObjString* a, ObjString* b)
 {
-    switch (getObjType(value))
-    {
-    case ObjType::STRING: return asString(value)->chars;
-    case ObjType::NATIVE: return "<native fn>";
-    case ObjType::FUNCTION: return "<" + asFunction(value)->name->chars + ">";
-    case ObjType::CLOSURE: return "<" + asClosure(value)->function->name->chars + ">";
-    case ObjType::BOUND_METHOD: return objectAsStr(asBoundMethod(value)->method);
-    case ObjType::RANGE: return std::to_string(asRange(value)->min) + ".." + std::to_string(asRange(value)->max);
-    case ObjType::LIST:
-    {
-        std::string list = "";
-        const std::vector<Value>& items = asList(value)->items;
-        for (auto current = items.begin(); current != items.end();)
-        {
-            list += objectAsStr(*current);
+    if (a->length == 0) return b;
+    if (b->length == 0) return a;
 
-            if (++current != items.end())
-                list += ",";
-        }
-        return list;
-    }
-    case ObjType::CLASS: return "" + asClass(value)->name->chars;
-    case ObjType::INSTANCE: return asInstance(value)->klass->name->chars + " instance";
+    if (a->length + b->length >= ROPE_MIN_LENGTH)
+    {
+        return track(new ObjRope(a, b));
     }
 
-    static_assert(static_cast<int>(ObjType::COUNT) == 10, "Missing enum value");
-    return "<Unknown>";
-}
-
-ObjString* objectAsString(const Value& value)
-{
-    return takeString(objectAsStr(value));
-}
-
-ObjString* concatenate(ObjString* a, ObjString* b)
-{
-    std::string concat = a->chars + b->chars; // TODO: This allocates memory! We are moving it to the ObjString
+    // The characters have to be contiguous to look them up in the intern table.
+    // The buffer is reused between calls, so only a string that isn't interned yet allocates.
+    static std::string buffer;
+    buffer.assign(a->chars(), a->length);
+    buffer.append(b->chars(), b->length);
 
-    ObjString* result = takeString(std::move(concat));
-    return result;
+    return copyString(buffer.c_str(), static_cast<int>(buffer.length()));
 }
\ No newline at end of file
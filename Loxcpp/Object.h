@@ -2,12 +2,18 @@
 #define loxcpp_object_h
 
 #include <string>
+#include <string_view>
+#include <memory>
 #include <iostream>
+#include <cmath>
 
 #include "Common.h"
 #include "Chunk.h"
 #include "Value.h"
 #include "HashTable.h"
+#include "Csv.h"
+#include "File.h"
+#include "Json.h"
 
 class VM;
 
@@ -23,6 +29,13 @@ enum class ObjType
     INSTANCE,
     RANGE,
     LIST,
+    ITERATOR,
+    MAP,
+    SET,
+    FLOAT_ARRAY,
+    STRING_BUILDER,
+    FILE,
+    BYTES,
 
     COUNT
 };
@@ -41,9 +54,16 @@ inline const char* objTypeToString(const ObjType type)
     case ObjType::INSTANCE: return "INSTANCE";
     case ObjType::RANGE: return "RANGE";
     case ObjType::LIST: return "LIST";
+    case ObjType::ITERATOR: return "ITERATOR";
+    case ObjType::MAP: return "MAP";
+    case ObjType::SET: return "SET";
+    case ObjType::FLOAT_ARRAY: return "FLOAT_ARRAY";
+    case ObjType::STRING_BUILDER: return "STRING_BUILDER";
+    case ObjType::FILE: return "FILE";
+    case ObjType::BYTES: return "BYTES";
     }
     return "UNKNOWN";
-    static_assert(static_cast<int>(ObjType::COUNT) == 10, "Missing enum value");
+    static_assert(static_cast<int>(ObjType::COUNT) == 17, "Missing enum value");
 }
 
 struct Obj
@@ -61,34 +81,135 @@ struct Obj
     bool isMarked;
 };
 
+enum class StringKind : uint8_t
+{
+    FLAT,   // Interned, characters stored inline
+    LONG,   // Too long to be worth interning, characters stored inline
+    ROPE,   // Concatenation of two strings or a buffer taken from a builder, not interned
+    SLICE,  // View of part of another string, not interned
+    MAPPED  // Contents of a file mapped in memory, not interned
+};
+
+// Flat and long strings are a single allocation, their null terminated characters are stored right after the object.
+// They have to be created with new (length) ObjString(chars, length), so there's room for them.
 struct ObjString : Obj
 {
-    ObjString(const char* chars, int length)
+    ObjString(const char* chars, int length, StringKind kind = StringKind::FLAT)
         : Obj(ObjType::STRING)
         , length(length)
-        , chars(chars, length)
+        , kind(kind)
     {
+        memcpy(this->chars(), chars, length);
+        this->chars()[length] = '\0';
 #ifdef DEBUG_OBJECT_LIFETIME
-        std::cout << "STRING created: " << this->chars << std::endl;
+        std::cout << "STRING created: " << this->chars() << std::endl;
 #endif
     }
-    ObjString(std::string&& str)
-        : Obj(ObjType::STRING)
-        , length(str.length())
-        , chars(std::move(str))
+    ~ObjString()
     {
 #ifdef DEBUG_OBJECT_LIFETIME
-        std::cout << "STRING created: " << this->chars << std::endl;
+        if (kind == StringKind::FLAT || kind == StringKind::LONG)
+            std::cout << "STRING destroyed: " << this->chars() << std::endl;
 #endif
     }
-    ~ObjString()
+
+    static void* operator new(size_t size, int length) { return ::operator new(size + length + 1); }
+    static void operator delete(void* pointer) { ::operator delete(pointer); }
+    static void operator delete(void* pointer, int length) { ::operator delete(pointer); }
+
+    // Ropes are flattened the first time their characters are accessed.
+    // Slices and mapped files are not null terminated, and their characters can't be modified.
+    char* chars()
     {
-#ifdef DEBUG_OBJECT_LIFETIME
-        std::cout << "STRING destroyed: " << this->chars << std::endl;
-#endif
+        switch (kind)
+        {
+        case StringKind::FLAT:
+        case StringKind::LONG: return reinterpret_cast<char*>(this + 1);
+        case StringKind::ROPE: return flatten();
+        case StringKind::SLICE: return sliceChars();
+        default: return mappedChars();
+        }
     }
+    const char* chars() const { return const_cast<ObjString*>(this)->chars(); }
+    std::string_view view() const { return std::string_view(chars(), length); }
+
+    bool isInterned() const { return kind == StringKind::FLAT; }
+
     int length;
-    std::string chars;
+    StringKind kind;
+
+protected:
+    ObjString(StringKind kind, int length)
+        : Obj(ObjType::STRING)
+        , length(length)
+        , kind(kind)
+    {}
+
+private:
+    char* flatten();
+    char* sliceChars();
+    char* mappedChars();
+};
+
+// Lazy concatenation, so building a long string piece by piece doesn't copy it on every step.
+// The first access to its characters copies the pieces into its own buffer and releases them.
+struct ObjRope : ObjString
+{
+    ObjRope(ObjString* left, ObjString* right)
+        : ObjString(StringKind::ROPE, left->length + right->length)
+        , left(left)
+        , right(right)
+        , flat(nullptr)
+    {}
+    // Takes ownership of a malloc'd, null terminated buffer, as if the rope was already flattened
+    ObjRope(char* flat, int length)
+        : ObjString(StringKind::ROPE, length)
+        , left(nullptr)
+        , right(nullptr)
+        , flat(flat)
+    {}
+    ~ObjRope()
+    {
+        free(flat);
+    }
+
+    static void* operator new(size_t size) { return ::operator new(size); }
+    static void operator delete(void* pointer) { ::operator delete(pointer); }
+
+    ObjString* left;  // Null once flattened
+    ObjString* right; // Null once flattened
+    char* flat;
+};
+
+// Substring that shares its parent's characters instead of copying them.
+// The parent is always a string that owns its characters, never another slice.
+struct ObjSlice : ObjString
+{
+    ObjSlice(ObjString* parent, int offset, int length)
+        : ObjString(StringKind::SLICE, length)
+        , parent(parent)
+        , offset(offset)
+    {}
+
+    static void* operator new(size_t size) { return ::operator new(size); }
+    static void operator delete(void* pointer) { ::operator delete(pointer); }
+
+    ObjString* parent;
+    int offset;
+};
+
+// The file stays mapped while the string is alive
+struct ObjMappedString : ObjString
+{
+    ObjMappedString(MappedFile&& file)
+        : ObjString(StringKind::MAPPED, static_cast<int>(file.size()))
+        , file(std::move(file))
+    {}
+
+    static void* operator new(size_t size) { return ::operator new(size); }
+    static void operator delete(void* pointer) { ::operator delete(pointer); }
+
+    MappedFile file;
 };
 
 struct ObjFunction : Obj
@@ -187,32 +308,61 @@ struct ObjNative : Obj
 
 struct ObjRange : Obj
 {
-    ObjRange(double min, double max)
+    ObjRange(double min, double max, double step)
         : Obj(ObjType::RANGE)
         , min(min)
         , max(max)
+        , step(std::fabs(step))
+        , count(elementCount(min, max, step))
     {}
 
+    // Amount of values visited when iterating from min to max, infinite for open ranges (5..)
+    static double elementCount(double min, double max, double step)
+    {
+        if (!std::isfinite(min)) return 0; // ..6 has no first value
+        if (std::isinf(max)) return HUGE_VAL;
+
+        // Small tolerance so float steps don't lose the last value by rounding: 0..1 step 0.1 has 11 values
+        return std::floor(std::fabs(max - min) / std::fabs(step) + 1e-9) + 1;
+    }
+
     bool contains(double value)
     {
         if (min < max) return value >= min && value<= max; // 1..5
         return value <= min && value >= max; // 5..1
     }
 
-    bool isInBounds(int idx)
+    // Indices are 64 bits, ranges can have more elements than an int can count
+    bool isInBounds(int64_t idx)
     {
-        if (min < max) return idx >= 0 && idx <= max - min; // 1..5
-        return idx >= 0 && idx <= min - max; // 5..1
+        return idx >= 0 && static_cast<double>(idx) < count;
     }
 
-    double getValue(int idx)
+    double getValue(int64_t idx)
     {
-        if (min < max) return min + idx; // 1..5
-        return min - idx; // 5..1
+        if (min < max) return min + static_cast<double>(idx) * step; // 1..5
+        return min - static_cast<double>(idx) * step; // 5..1
+    }
+
+    // Last value visited, for ranges with a finite count
+    double lastValue()
+    {
+        if (min < max) return min + (count - 1) * step;
+        return min - (count - 1) * step;
+    }
+
+    // Closed form search of a value, returns -1 if the range never visits it
+    double indexOf(double value)
+    {
+        const double idx = std::round(min < max ? (value - min) / step : (min - value) / step);
+        if (idx < 0 || idx >= count) return -1;
+        return getValue(static_cast<int64_t>(idx)) == value ? idx : -1;
     }
 
     double min;
     double max;
+    double step;
+    double count;
 };
 
 struct ObjList : Obj
@@ -249,6 +399,162 @@ struct ObjList : Obj
     std::vector<Value> items;
 };
 
+// List of unboxed doubles, stored contiguously without a type tag per element
+struct ObjFloatArray : Obj
+{
+    ObjFloatArray()
+        : Obj(ObjType::FLOAT_ARRAY)
+    {}
+
+    void append(double value)
+    {
+        items.push_back(value);
+    }
+
+    void setValue(int index, double value)
+    {
+        items[index] = value;
+    }
+
+    double getValue(int index) const
+    {
+        return items[index];
+    }
+
+    bool isInBounds(int index) const
+    {
+        return index >= 0 && static_cast<size_t>(index) < items.size();
+    }
+
+    std::vector<double> items;
+};
+
+// Growable character buffer, for building text without creating a string on every step
+struct ObjStringBuilder : Obj
+{
+    ObjStringBuilder()
+        : Obj(ObjType::STRING_BUILDER)
+        , chars(nullptr)
+        , length(0)
+        , capacity(0)
+    {}
+    ~ObjStringBuilder()
+    {
+        free(chars);
+    }
+
+    void append(const char* text, int count);
+    void reserve(int count);
+
+    // Hands the buffer over to the caller, leaving the builder empty
+    char* release();
+
+    char* chars;  // Null terminated once anything has been appended
+    int length;
+    int capacity;
+};
+
+// Handle of a file open for writing. If it's not closed explicitly, it's closed when it's collected.
+struct ObjFile : Obj
+{
+    ObjFile()
+        : Obj(ObjType::FILE)
+    {}
+
+    FileWriter writer;
+};
+
+// Fixed size buffer of raw bytes. A slice is a view of the bytes of another buffer, so writing
+// to one changes the other. Buffers never change size, so the bytes of a view stay where they are.
+struct ObjBytes : Obj
+{
+    ObjBytes(size_t length)
+        : Obj(ObjType::BYTES)
+        , storage(length)
+        , parent(nullptr)
+        , offset(0)
+        , length(length)
+    {}
+
+    ObjBytes(ObjBytes* parent, size_t offset, size_t length)
+        : Obj(ObjType::BYTES)
+        , parent(parent)
+        , offset(offset)
+        , length(length)
+    {}
+
+    uint8_t* data() { return parent != nullptr ? parent->storage.data() + offset : storage.data(); }
+
+    bool isInBounds(int index) const
+    {
+        return index >= 0 && static_cast<size_t>(index) < length;
+    }
+
+    std::vector<uint8_t> storage; // Empty for a view
+    ObjBytes* parent;             // Buffer that owns the bytes of a view, never a view itself
+    size_t offset;
+    size_t length;
+};
+
+enum class IteratorKind : uint8_t
+{
+    MAP,
+    FILTER,
+    TAKE,
+    ZIP,
+    LINES,
+    JSON_EVENTS,
+    CSV_ROWS
+};
+
+// Lazy iterator: pulls elements from its source one at a time, only when they are requested.
+// Iterators are single pass, once an element is consumed it can't be visited again.
+struct ObjIterator : Obj
+{
+    ObjIterator(IteratorKind kind, const Value& source, const Value& argument)
+        : Obj(ObjType::ITERATOR)
+        , kind(kind)
+        , source(source)
+        , argument(argument)
+        , current()
+        , sourceIndex(0)
+        , argumentIndex(0)
+        , index(0)
+        , exhausted(false)
+    {}
+
+    IteratorKind kind;
+    Value source;       // Iterable the elements are pulled from, file path for LINES, JSON_EVENTS and CSV_ROWS
+    Value argument;     // Function for MAP and FILTER, limit for TAKE, second iterable for ZIP
+    Value current;      // Last element produced, kept here so the GC can reach it
+    int64_t sourceIndex;    // Cursor into the source, when it's not an iterator itself
+    int64_t argumentIndex;  // Cursor into the argument, for ZIP
+    int index;          // Amount of elements produced so far
+    bool exhausted;
+    std::unique_ptr<LineReader> reader; // Open file for LINES, closed once exhausted
+    std::unique_ptr<JsonEventReader> jsonReader; // Open file for JSON_EVENTS, closed once exhausted
+    std::unique_ptr<CsvReader> csvReader; // Open file for CSV_ROWS, closed once exhausted
+};
+
+struct ObjMap : Obj
+{
+    ObjMap()
+        : Obj(ObjType::MAP)
+    {}
+
+    ValueTable table;
+};
+
+// Sets reuse the map table, elements are stored as keys with a nil value
+struct ObjSet : Obj
+{
+    ObjSet()
+        : Obj(ObjType::SET)
+    {}
+
+    ValueTable table;
+};
+
 inline ObjType getObjType(const Value& value) { return asObject(value)->type; }
 inline bool isObjType(const Value& value, const ObjType type)
 {
@@ -263,8 +569,16 @@ inline bool isFunction(const Value& value) { return isObjType(value, ObjType::FU
 inline bool isNative(const Value& value) { return isObjType(value, ObjType::NATIVE); }
 inline bool isRange(const Value& value) { return isObjType(value, ObjType::RANGE); }
 inline bool isList(const Value& value) { return isObjType(value, ObjType::LIST); }
+inline bool isIterator(const Value& value) { return isObjType(value, ObjType::ITERATOR); }
+inline bool isMap(const Value& value) { return isObjType(value, ObjType::MAP); }
+inline bool isSet(const Value& value) { return isObjType(value, ObjType::SET); }
+inline bool isFloatArray(const Value& value) { return isObjType(value, ObjType::FLOAT_ARRAY); }
+inline bool isStringBuilder(const Value& value) { return isObjType(value, ObjType::STRING_BUILDER); }
+inline bool isFile(const Value& value) { return isObjType(value, ObjType::FILE); }
+inline bool isBytes(const Value& value) { return isObjType(value, ObjType::BYTES); }
 
-inline const char* asCString(const Value& value) { return static_cast<ObjString*>(asObject(value))->chars.c_str(); }
+// Not null terminated for slices, use view() when the string may be one
+inline const char* asCString(const Value& value) { return static_cast<ObjString*>(asObject(value))->chars(); }
 
 inline ObjString* asString(const Value& value) { return static_cast<ObjString*>(asObject(value)); }
 inline ObjInstance* asInstance(const Value& value) { return static_cast<ObjInstance*>(asObject(value)); }
@@ -275,10 +589,26 @@ inline ObjFunction* asFunction(const Value& value) { return static_cast<ObjFunct
 inline ObjNative* asNative(const Value& value) { return static_cast<ObjNative*>(asObject(value)); }
 inline ObjRange* asRange(const Value& value) { return static_cast<ObjRange*>(asObject(value)); }
 inline ObjList* asList(const Value& value) { return static_cast<ObjList*>(asObject(value)); }
-
+inline ObjIterator* asIterator(const Value& value) { return static_cast<ObjIterator*>(asObject(value)); }
+inline ObjMap* asMap(const Value& value) { return static_cast<ObjMap*>(asObject(value)); }
+inline ObjSet* asSet(const Value& value) { return static_cast<ObjSet*>(asObject(value)); }
+inline ObjFloatArray* asFloatArray(const Value& value) { return static_cast<ObjFloatArray*>(asObject(value)); }
+inline ObjStringBuilder* asStringBuilder(const Value& value) { return static_cast<ObjStringBuilder*>(asObject(value)); }
+inline ObjFile* asFile(const Value& value) { return static_cast<ObjFile*>(asObject(value)); }
+inline ObjBytes* asBytes(const Value& value) { return static_cast<ObjBytes*>(asObject(value)); }
+
+uint32_t hashString(const char* key, int length);
+uint32_t stringHash(ObjString* string);
+ObjString* internString(ObjString* string);
+ObjString* sliceString(ObjString* string, int start, int length);
+Value tableKey(const Value& key);
+// copyString always interns, it's meant for identifiers and constants.
+// takeString is for text built at runtime, and only interns it when it's short.
 ObjString* copyString(const char* chars, int length);
 ObjString* takeString(const char* chars, int length);
 ObjString* takeString(std::string&& chars);
+ObjString* newMappedString(MappedFile&& file);
+ObjString* takeBuffer(char* chars, int length);
 
 ObjUpvalue* newUpvalue(Value* slot);
 ObjInstance* newInstance(ObjClass* klass);
@@ -288,13 +618,23 @@ ObjClosure* newClosure(ObjFunction* function);
 ObjFunction* newFunction();
 ObjNative* newNative(uint8_t arity, NativeFn function, bool isMethod);
 
-ObjRange* newRange(double min, double max);
+ObjRange* newRange(double min, double max, double step = 1.0);
 ObjList* newList();
-
-void printObject(const Value& value);
+ObjIterator* newIterator(IteratorKind kind, const Value& source, const Value& argument);
+ObjIterator* newLinesIterator(ObjString* path);
+ObjIterator* newJsonEventsIterator(ObjString* path);
+ObjIterator* newCsvRowsIterator(ObjString* path, char delimiter);
+ObjMap* newMap();
+ObjSet* newSet();
+ObjFloatArray* newFloatArray();
+ObjStringBuilder* newStringBuilder();
+ObjFile* newFile();
+ObjBytes* newBytes(size_t length);
+ObjBytes* sliceBytes(ObjBytes* bytes, size_t start, size_t length);
+
+void printObject(std::string& out, const Value& value);
 size_t sizeOfObject(const Value& value);
 
-ObjString* objectAsString(const Value& value);
 ObjString* concatenate(ObjString* a, ObjString* b);
 
 #endif
\ No newline at end of file
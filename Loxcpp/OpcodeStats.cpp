@@ -0,0 +1,188 @@
+#include "OpcodeStats.h"
+
+#ifdef DEBUG_OPCODE_STATS
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+#include "Object.h"
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define OPCODE_STATS_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define OPCODE_STATS_RDTSC
+#endif
+
+// Reading the counter on every instruction would cost more than most instructions. The interval
+// between measures is random, or loops whose length divides it would always measure the same opcodes.
+#define OPCODE_STATS_MIN_CYCLE_INTERVAL 32
+
+// Rows printed for the pairs and the instructions
+#define OPCODE_STATS_TOP 30
+
+static inline uint64_t readCycles()
+{
+#ifdef OPCODE_STATS_RDTSC
+    return __rdtsc();
+#else
+    // Nanoseconds where there is no time stamp counter
+    return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+void OpcodeStats::record(OpCode opCode, const ObjFunction* function, size_t offset)
+{
+    // The cycles of the previous instruction last until this one starts
+    if (timed != OPCODE_COUNT)
+    {
+        cycles[timed] += readCycles() - timedStart;
+        ++cycleSamples[timed];
+        timed = OPCODE_COUNT;
+    }
+
+    const size_t index = static_cast<size_t>(opCode);
+    ++counts[index];
+    if (previous != OPCODE_COUNT)
+        ++pairs[previous][index];
+    previous = index;
+
+    if (function != lastFunction)
+    {
+        FunctionStats& stats = functions[function];
+        if (stats.counts.empty())
+        {
+            stats.name = function->name != nullptr ? std::string(function->name->view()) : "script";
+            stats.code = function->chunk.code;
+            stats.lines = function->chunk.lines;
+            stats.counts.resize(function->chunk.code.size());
+        }
+        lastFunction = function;
+        lastStats = &stats;
+    }
+    if (offset < lastStats->counts.size())
+        ++lastStats->counts[offset];
+
+    ++executed;
+    if (--untilTimed == 0)
+    {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        untilTimed = OPCODE_STATS_MIN_CYCLE_INTERVAL + random % (2 * OPCODE_STATS_MIN_CYCLE_INTERVAL);
+
+        timed = index;
+        timedStart = readCycles();
+    }
+}
+
+void OpcodeStats::forget(const ObjFunction* function)
+{
+    const auto found = functions.find(function);
+    if (found == functions.end()) return;
+
+    freed.push_back(std::move(found->second));
+    functions.erase(found);
+
+    if (lastFunction == function)
+    {
+        lastFunction = nullptr;
+        lastStats = nullptr;
+    }
+}
+
+static double percent(uint64_t part, uint64_t total)
+{
+    return total == 0 ? 0.0 : 100.0 * static_cast<double>(part) / static_cast<double>(total);
+}
+
+void OpcodeStats::report(std::ostream& out) const
+{
+    const std::ios_base::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(2);
+
+    std::vector<size_t> opCodes;
+    for (size_t i = 0; i < OPCODE_COUNT; ++i)
+    {
+        if (counts[i] > 0) opCodes.push_back(i);
+    }
+    std::sort(opCodes.begin(), opCodes.end(), [this](size_t a, size_t b) { return counts[a] > counts[b]; });
+
+#ifdef OPCODE_STATS_RDTSC
+    const char* cycleUnit = "cycles";
+#else
+    const char* cycleUnit = "ns";
+#endif
+
+    out << "== Opcodes: " << executed << " executed ==" << std::endl;
+    out << std::left << std::setw(24) << "opcode" << std::right << std::setw(14) << "count" << std::setw(9) << "%"
+        << std::setw(12) << cycleUnit << std::endl;
+    for (size_t opCode : opCodes)
+    {
+        const double average = cycleSamples[opCode] > 0
+            ? static_cast<double>(cycles[opCode]) / static_cast<double>(cycleSamples[opCode])
+            : 0.0;
+
+        out << std::left << std::setw(24) << opCodeToString(static_cast<OpCode>(opCode))
+            << std::right << std::setw(14) << counts[opCode]
+            << std::setw(9) << percent(counts[opCode], executed)
+            << std::setw(12) << average << std::endl;
+    }
+
+    struct Pair { size_t first; size_t second; uint64_t count; };
+    std::vector<Pair> sortedPairs;
+    for (size_t first = 0; first < OPCODE_COUNT; ++first)
+    {
+        for (size_t second = 0; second < OPCODE_COUNT; ++second)
+        {
+            if (pairs[first][second] > 0) sortedPairs.push_back({ first, second, pairs[first][second] });
+        }
+    }
+    std::sort(sortedPairs.begin(), sortedPairs.end(), [](const Pair& a, const Pair& b) { return a.count > b.count; });
+
+    out << "== Opcode pairs ==" << std::endl;
+    for (size_t i = 0; i < sortedPairs.size() && i < OPCODE_STATS_TOP; ++i)
+    {
+        const Pair& pair = sortedPairs[i];
+        const std::string name = std::string(opCodeToString(static_cast<OpCode>(pair.first))) + " "
+            + opCodeToString(static_cast<OpCode>(pair.second));
+        out << std::left << std::setw(38) << name << std::right << std::setw(14) << pair.count
+            << std::setw(9) << percent(pair.count, executed) << std::endl;
+    }
+
+    struct Site { const FunctionStats* function; size_t offset; uint64_t count; };
+    std::vector<Site> sites;
+    auto addSites = [&sites](const FunctionStats& stats)
+    {
+        for (size_t offset = 0; offset < stats.counts.size(); ++offset)
+        {
+            if (stats.counts[offset] > 0) sites.push_back({ &stats, offset, stats.counts[offset] });
+        }
+    };
+    for (const auto& [function, stats] : functions)
+    {
+        addSites(stats);
+    }
+    for (const FunctionStats& stats : freed)
+    {
+        addSites(stats);
+    }
+    std::sort(sites.begin(), sites.end(), [](const Site& a, const Site& b) { return a.count > b.count; });
+
+    out << "== Instructions ==" << std::endl;
+    for (size_t i = 0; i < sites.size() && i < OPCODE_STATS_TOP; ++i)
+    {
+        const Site& site = sites[i];
+        const std::string name = site.function->name + "+" + std::to_string(site.offset)
+            + " [line " + std::to_string(site.function->lines[site.offset]) + "]";
+        out << std::left << std::setw(38) << name
+            << std::setw(24) << opCodeToString(static_cast<OpCode>(site.function->code[site.offset])) << std::right << std::setw(14) << site.count
+            << std::setw(9) << percent(site.count, executed) << std::endl;
+    }
+
+    out.flags(flags);
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef loxcpp_opcode_stats_h
+#define loxcpp_opcode_stats_h
+
+#include "Common.h"
+
+#ifdef DEBUG_OPCODE_STATS
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Chunk.h"
+
+struct ObjFunction;
+
+// Counts what the VM executes: every opcode, every pair of consecutive opcodes, which are the
+// candidates to fuse into a single instruction, and every instruction of every function.
+// The cycles of about one in 64 instructions are measured too, from the time stamp counter
+// when there is one. They include reading the counter, so they are only good to compare opcodes.
+class OpcodeStats
+{
+public:
+
+    void record(OpCode opCode, const ObjFunction* function, size_t offset);
+
+    // Called when a function is freed, so a new function at the same address starts its own counts
+    void forget(const ObjFunction* function);
+
+    // Sorted tables of the opcodes, the pairs and the hottest instructions
+    void report(std::ostream& out) const;
+
+private:
+
+    static constexpr size_t OPCODE_COUNT = static_cast<size_t>(OpCode::COUNT);
+
+    struct FunctionStats
+    {
+        std::string name;
+        std::vector<uint8_t> code; // Copied, the function can be collected before the report
+        std::vector<int> lines;
+        std::vector<uint64_t> counts;
+    };
+
+    std::array<uint64_t, OPCODE_COUNT> counts = {};
+    std::array<std::array<uint64_t, OPCODE_COUNT>, OPCODE_COUNT> pairs = {};
+    std::array<uint64_t, OPCODE_COUNT> cycles = {};
+    std::array<uint64_t, OPCODE_COUNT> cycleSamples = {};
+
+    std::unordered_map<const ObjFunction*, FunctionStats> functions;
+    std::vector<FunctionStats> freed; // Counts of the functions that were already collected
+    const ObjFunction* lastFunction = nullptr;
+    FunctionStats* lastStats = nullptr;
+
+    size_t previous = OPCODE_COUNT; // Nothing executed yet
+    size_t timed = OPCODE_COUNT;    // Opcode whose cycles are being measured
+    uint64_t timedStart = 0;
+    uint64_t untilTimed = 1;
+    uint64_t random = 0x9E3779B97F4A7C15ull;
+    uint64_t executed = 0;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,175 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+
+#include "Vm.h"
+
+void SamplingProfiler::start()
+{
+    if (timer.joinable()) return;
+
+    running = true;
+    timer = std::thread(&SamplingProfiler::tick, this);
+}
+
+void SamplingProfiler::stop()
+{
+    if (!timer.joinable()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(timerMutex);
+        running = false;
+    }
+    timerWake.notify_one();
+    timer.join();
+}
+
+void SamplingProfiler::tick()
+{
+    std::unique_lock<std::mutex> lock(timerMutex);
+    while (!timerWake.wait_for(lock, interval, [this]() { return !running; }))
+    {
+        pendingTicks.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void SamplingProfiler::sample(const CallFrame* frames, size_t frameCount)
+{
+    const uint32_t ticks = pendingTicks.exchange(0, std::memory_order_relaxed);
+    if (ticks == 0) return;
+
+    scratch.clear();
+    for (size_t i = 0; i < frameCount; ++i)
+    {
+        const ObjFunction* function = frames[i].closure->function;
+        const Chunk& chunk = function->chunk;
+
+        // Callers are past their call instruction, the innermost frame is at the instruction about to run
+        size_t offset = frames[i].ip - chunk.code.data();
+        if (i + 1 < frameCount && offset > 0) --offset;
+
+        if (i > 0) scratch += ';';
+        if (function->name == nullptr)
+            scratch += "script";
+        else
+            scratch += function->name->view();
+        scratch += ':';
+        scratch += std::to_string(offset < chunk.lines.size() ? chunk.lines[offset] : 0);
+    }
+
+    stacks[scratch] += ticks;
+}
+
+bool SamplingProfiler::writeFolded(const char* path) const
+{
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) return false;
+
+    for (const auto& [stack, count] : stacks)
+    {
+        fprintf(file, "%s %llu\n", stack.c_str(), static_cast<unsigned long long>(count));
+    }
+    return fclose(file) == 0;
+}
+
+void CallProfiler::enter(const Obj* function)
+{
+    auto found = indices.find(function);
+    if (found == indices.end())
+    {
+        found = indices.emplace(function, functions.size()).first;
+        functions.emplace_back().name = functionName(function);
+        active.push_back(0);
+    }
+
+    const size_t index = found->second;
+    ++active[index];
+    stack.push_back({ index, Clock::now(), allocations, 0.0, 0 });
+}
+
+void CallProfiler::exit()
+{
+    if (stack.empty()) return;
+
+    const Call call = stack.back();
+    stack.pop_back();
+
+    const double time = std::chrono::duration<double>(Clock::now() - call.start).count();
+    const uint64_t callAllocations = allocations - call.allocationsAtStart;
+
+    CallStats& stats = functions[call.function];
+    ++stats.calls;
+    stats.selfTime += time - call.childTime;
+    stats.selfAllocations += callAllocations - call.childAllocations;
+
+    // The outer call of a recursion already includes the inner ones
+    if (--active[call.function] == 0)
+    {
+        stats.time += time;
+        stats.allocations += callAllocations;
+    }
+
+    if (!stack.empty())
+    {
+        stack.back().childTime += time;
+        stack.back().childAllocations += callAllocations;
+    }
+}
+
+void CallProfiler::unwind()
+{
+    while (!stack.empty())
+    {
+        exit();
+    }
+}
+
+std::string CallProfiler::functionName(const Obj* function) const
+{
+    if (function->type == ObjType::FUNCTION)
+    {
+        const ObjFunction* closureFunction = static_cast<const ObjFunction*>(function);
+        return closureFunction->name != nullptr ? std::string(closureFunction->name->view()) : "script";
+    }
+
+    // Natives don't know their names, they are found in the globals once
+    std::string name = "<native>";
+    VM::getInstance().globalTable().forEach([&](ObjString* key, const Value& value)
+    {
+        if (isObject(value) && asObject(value) == function)
+            name = std::string(key->view());
+    });
+    return name;
+}
+
+std::vector<CallStats> CallProfiler::results() const
+{
+    std::vector<CallStats> sorted;
+    for (const CallStats& stats : functions)
+    {
+        if (stats.calls > 0) sorted.push_back(stats);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const CallStats& a, const CallStats& b) { return a.selfTime > b.selfTime; });
+    return sorted;
+}
+
+void CallProfiler::report(std::ostream& out) const
+{
+    const std::ios_base::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+
+    out << "== Calls ==" << std::endl;
+    out << std::left << std::setw(24) << "function" << std::right << std::setw(12) << "calls"
+        << std::setw(12) << "time ms" << std::setw(12) << "self ms"
+        << std::setw(14) << "allocations" << std::setw(14) << "self allocs" << std::endl;
+    for (const CallStats& stats : results())
+    {
+        out << std::left << std::setw(24) << stats.name << std::right << std::setw(12) << stats.calls
+            << std::setw(12) << stats.time * 1000.0 << std::setw(12) << stats.selfTime * 1000.0
+            << std::setw(14) << stats.allocations << std::setw(14) << stats.selfAllocations << std::endl;
+    }
+
+    out.flags(flags);
+}
@@ -0,0 +1,118 @@
+#ifndef loxcpp_profiler_h
+#define loxcpp_profiler_h
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct CallFrame;
+struct Obj;
+
+// Samples the call stack of the script at a fixed interval. A timer thread counts ticks, and the VM
+// takes the sample at its next instruction, so the stacks are only read from the thread running the script.
+// Ticks that pass while a native is running are added to the same sample, so time spent in natives
+// goes to the line that called them.
+class SamplingProfiler
+{
+public:
+
+    explicit SamplingProfiler(std::chrono::microseconds interval = std::chrono::microseconds(1000))
+        : interval(interval)
+    {}
+
+    SamplingProfiler(const SamplingProfiler&) = delete;
+    SamplingProfiler& operator=(const SamplingProfiler&) = delete;
+
+    ~SamplingProfiler()
+    {
+        stop();
+    }
+
+    void start();
+    void stop();
+
+    bool isSampleDue() const { return pendingTicks.load(std::memory_order_relaxed) != 0; }
+    void sample(const CallFrame* frames, size_t frameCount);
+
+    // One line per distinct stack, "script:12;fib:4;fib:4 37", the format read by flame graph tools
+    bool writeFolded(const char* path) const;
+
+private:
+
+    void tick();
+
+    std::chrono::microseconds interval;
+    std::atomic<uint32_t> pendingTicks = 0;
+
+    std::thread timer;
+    std::mutex timerMutex;
+    std::condition_variable timerWake;
+    bool running = false;
+
+    std::unordered_map<std::string, uint64_t> stacks;
+    std::string scratch;
+};
+
+struct CallStats
+{
+    std::string name;
+    uint64_t calls = 0;
+    double time = 0.0;     // Seconds from the call to the return, including the calls it made
+    double selfTime = 0.0; // Seconds spent in the function itself
+    uint64_t allocations = 0;
+    uint64_t selfAllocations = 0;
+};
+
+// Exact statistics of every function and native called, collected on every call and return.
+// Recursive calls only count their time and allocations once, in the outermost call.
+class CallProfiler
+{
+public:
+
+    // The function is the ObjFunction of a closure, or an ObjNative
+    void enter(const Obj* function);
+    void exit();
+
+    // Closes the calls that are still running, after a runtime error
+    void unwind();
+
+    // Called when a function is freed, so a new object at the same address gets its own entry
+    void forget(const Obj* function) { indices.erase(function); }
+
+    void countAllocation() { ++allocations; }
+
+    // Functions that returned at least once, sorted by self time
+    std::vector<CallStats> results() const;
+
+    void report(std::ostream& out) const;
+
+private:
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Call
+    {
+        size_t function;
+        Clock::time_point start;
+        uint64_t allocationsAtStart;
+        double childTime;
+        uint64_t childAllocations;
+    };
+
+    std::string functionName(const Obj* function) const;
+
+    std::unordered_map<const Obj*, size_t> indices;
+    std::vector<CallStats> functions;
+    std::vector<int> active; // Calls of each function on the stack, to detect recursion
+    std::vector<Call> stack;
+    uint64_t allocations = 0;
+};
+
+#endif
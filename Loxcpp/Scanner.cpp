@@ -14,12 +14,12 @@ const std::string& tokenTypeToString(const TokenType type)
         "PERCENTAGE",
 
         // Literals.
-        "IDENTIFIER", "STRING", "NUMBER",
+        "IDENTIFIER", "STRING", "INTERPOLATION", "NUMBER",
 
         // Keywords.
         "AND", "CLASS", "ELSE", "FALSE", "FUN", "FOR", "IF", "NIL", "OR",
         "PRINT", "RETURN", "SUPER", "THIS", "TRUE", "VAR", "CONST", "WHILE",
-        "MATCH", "CASE", "BREAK", "CONTINUE", "IN",
+        "MATCH", "CASE", "BREAK", "CONTINUE", "IN", "STEP",
 
         "ERROR", "EOFILE"
     };
@@ -19,12 +19,12 @@ enum class TokenType
     PERCENTAGE,
 
     // Literals.
-    IDENTIFIER, STRING, NUMBER,
+    IDENTIFIER, STRING, INTERPOLATION, NUMBER,
 
     // Keywords.
     AND, CLASS, ELSE, FALSE, FUN, FOR, IF, NIL, OR,
     PRINT, RETURN, SUPER, THIS, TRUE, VAR, CONST, WHILE,
-    MATCH, CASE, BREAK, CONTINUE, IN,
+    MATCH, CASE, BREAK, CONTINUE, IN, STEP,
 
     ERROR, EOFILE
 };
@@ -56,6 +56,7 @@ public:
         start = 0;
         current = 0;
         line = 1;
+        interpolations.clear();
     }
 
     Token scanToken()
@@ -79,8 +80,21 @@ public:
         {
             case '(': return makeToken(TokenType::LEFT_PAREN);
             case ')': return makeToken(TokenType::RIGHT_PAREN);
-            case '{': return makeToken(TokenType::LEFT_BRACE);
-            case '}': return makeToken(TokenType::RIGHT_BRACE);
+            case '{':
+                if (!interpolations.empty()) interpolations.back()++;
+                return makeToken(TokenType::LEFT_BRACE);
+            case '}':
+                if (!interpolations.empty())
+                {
+                    // The brace closing an interpolated expression resumes the string
+                    if (interpolations.back() == 0)
+                    {
+                        interpolations.pop_back();
+                        return string();
+                    }
+                    interpolations.back()--;
+                }
+                return makeToken(TokenType::RIGHT_BRACE);
             case '[': return makeToken(TokenType::LEFT_BRACKET);
             case ']': return makeToken(TokenType::RIGHT_BRACKET);
             case ',': return makeToken(TokenType::COMMA);
@@ -195,10 +209,21 @@ private:
         return makeToken(TokenType::NUMBER);
     }
 
+    // Strings with interpolated expressions, like "id=${id}", are split in several tokens.
+    // Every piece followed by an expression is an INTERPOLATION token, the last one is a STRING.
+    // The first character of each piece is either the opening " or the } closing the previous expression.
     Token string()
     {
         while (peek() != '"' && !isAtEnd())
         {
+            if (peek() == '$' && peekNext() == '{')
+            {
+                advance();
+                advance();
+                interpolations.push_back(0);
+                return makeToken(TokenType::INTERPOLATION);
+            }
+
             if (peek() == '\n') line++;
             advance();
         }
@@ -270,7 +295,16 @@ private:
             case 'o': return checkKeyword(1, 1, "r", TokenType::OR);
             case 'p': return checkKeyword(1, 4, "rint", TokenType::PRINT);
             case 'r': return checkKeyword(1, 5, "eturn", TokenType::RETURN);
-            case 's': return checkKeyword(1, 4, "uper", TokenType::SUPER);
+            case 's':
+                if (current - start > 1)
+                {
+                    switch (source.at(start + 1))
+                    {
+                    case 't': return checkKeyword(2, 2, "ep", TokenType::STEP);
+                    case 'u': return checkKeyword(2, 3, "per", TokenType::SUPER);
+                    }
+                }
+                break;
             case 'v': return checkKeyword(1, 2, "ar", TokenType::VAR);
             case 'w': return checkKeyword(1, 4, "hile", TokenType::WHILE);
             case 'f':
@@ -345,6 +379,7 @@ private:
     }
 
     std::string source;
+    std::vector<int> interpolations; // Open braces inside each interpolated expression being scanned
     size_t start = 0;
     size_t current = 0;
     size_t line = 1;
@@ -0,0 +1,544 @@
+#include "Serialize.h"
+
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#include "File.h"
+#include "Object.h"
+#include "Vm.h"
+
+#define SERIALIZE_MAGIC "LOXS"
+#define SERIALIZE_MAGIC_LENGTH 4
+#define SERIALIZE_VERSION 1
+
+// Deeper values are rejected, writing and reading recurse once per level
+#define SERIALIZE_MAX_DEPTH 512
+
+// Size of the encoding kept in memory before it's written, when writing to a file
+#define SERIALIZE_BUFFER_SIZE (64 * 1024)
+
+enum class Tag : uint8_t
+{
+    NIL,
+    BOOL_FALSE,
+    BOOL_TRUE,
+    INTEGER,     // Zigzag varint, for whole numbers that fit exactly in a double
+    NUMBER,      // 8 bytes, little endian
+    STRING,      // Varint length and the characters, the string gets the next string index
+    STRING_REF,  // Varint index of a string written before
+    LIST,        // Varint count and the elements
+    MAP,         // Varint count and the keys and values
+    SET,         // Varint count and the elements
+    FLOAT_ARRAY, // Varint count and 8 bytes per element
+    INSTANCE,    // Class name, varint count, and the names and values of the fields
+    OBJECT_REF,  // Varint index of a list, map, set, float array, bytes or instance written before
+    BYTES,       // Varint length and the bytes, views are written as a copy of the bytes they see
+    COUNT
+};
+
+class Serializer
+{
+public:
+
+    Serializer(std::string& out, FileWriter* file)
+        : out(out)
+        , file(file)
+    {}
+
+    bool write(const Value& value)
+    {
+        out.append(SERIALIZE_MAGIC, SERIALIZE_MAGIC_LENGTH);
+        writeByte(SERIALIZE_VERSION);
+
+        const bool written = writeValue(value, 0);
+        return flush() && written && !failed;
+    }
+
+private:
+
+    void writeByte(uint8_t byte)
+    {
+        out += static_cast<char>(byte);
+    }
+
+    void writeTag(Tag tag)
+    {
+        writeByte(static_cast<uint8_t>(tag));
+    }
+
+    void writeVarint(uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            writeByte(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        writeByte(static_cast<uint8_t>(value));
+    }
+
+    void writeDouble(double value)
+    {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        for (int i = 0; i < 8; ++i)
+        {
+            writeByte(static_cast<uint8_t>(bits >> (i * 8)));
+        }
+    }
+
+    void writeNumber(double number)
+    {
+        // Most numbers are whole and small, a varint takes 1 to 3 bytes for them instead of 8
+        const bool whole = std::trunc(number) == number && std::fabs(number) < 9007199254740992.0;
+        if (whole && !(number == 0.0 && std::signbit(number)))
+        {
+            const int64_t integer = static_cast<int64_t>(number);
+            writeTag(Tag::INTEGER);
+            writeVarint((static_cast<uint64_t>(integer) << 1) ^ static_cast<uint64_t>(integer >> 63));
+            return;
+        }
+
+        writeTag(Tag::NUMBER);
+        writeDouble(number);
+    }
+
+    void writeString(ObjString* string)
+    {
+        const std::string_view text = string->view();
+
+        const auto found = strings.find(text);
+        if (found != strings.end())
+        {
+            writeTag(Tag::STRING_REF);
+            writeVarint(found->second);
+            return;
+        }
+
+        strings.emplace(text, static_cast<uint32_t>(strings.size()));
+        writeTag(Tag::STRING);
+        writeVarint(text.length());
+        out.append(text.data(), text.length());
+        flushIfFull();
+    }
+
+    // Writes a reference if the object was already written. Otherwise it gets the next object index.
+    bool writeObjectRef(const Obj* object)
+    {
+        const auto found = objects.find(object);
+        if (found != objects.end())
+        {
+            writeTag(Tag::OBJECT_REF);
+            writeVarint(found->second);
+            return true;
+        }
+
+        objects.emplace(object, static_cast<uint32_t>(objects.size()));
+        return false;
+    }
+
+    bool writeValue(const Value& value, int depth)
+    {
+        if (depth > SERIALIZE_MAX_DEPTH) return false;
+
+        switch (value.type)
+        {
+        case ValueType::NIL: writeTag(Tag::NIL); return true;
+        case ValueType::BOOL: writeTag(asBoolean(value) ? Tag::BOOL_TRUE : Tag::BOOL_FALSE); return true;
+        case ValueType::NUMBER: writeNumber(asNumber(value)); return true;
+        case ValueType::OBJ: break;
+        }
+
+        switch (getObjType(value))
+        {
+        case ObjType::STRING:
+            writeString(asString(value));
+            return true;
+        case ObjType::LIST:
+        {
+            if (writeObjectRef(asObject(value))) return true;
+
+            const std::vector<Value>& items = asList(value)->items;
+            writeTag(Tag::LIST);
+            writeVarint(items.size());
+            for (const Value& item : items)
+            {
+                if (!writeValue(item, depth + 1)) return false;
+                flushIfFull();
+            }
+            return true;
+        }
+        case ObjType::MAP:
+        case ObjType::SET:
+        {
+            if (writeObjectRef(asObject(value))) return true;
+
+            const bool isMapValue = isMap(value);
+            const ValueTable& table = isMapValue ? asMap(value)->table : asSet(value)->table;
+            writeTag(isMapValue ? Tag::MAP : Tag::SET);
+            writeVarint(table.count());
+            for (size_t i = 0; i < table.count(); ++i)
+            {
+                if (!writeValue(table.entryAt(i).key, depth + 1)) return false;
+                if (isMapValue && !writeValue(table.entryAt(i).value, depth + 1)) return false;
+                flushIfFull();
+            }
+            return true;
+        }
+        case ObjType::FLOAT_ARRAY:
+        {
+            if (writeObjectRef(asObject(value))) return true;
+
+            const std::vector<double>& items = asFloatArray(value)->items;
+            writeTag(Tag::FLOAT_ARRAY);
+            writeVarint(items.size());
+            for (double item : items)
+            {
+                writeDouble(item);
+                flushIfFull();
+            }
+            return true;
+        }
+        case ObjType::BYTES:
+        {
+            if (writeObjectRef(asObject(value))) return true;
+
+            ObjBytes* bytes = asBytes(value);
+            writeTag(Tag::BYTES);
+            writeVarint(bytes->length);
+            out.append(reinterpret_cast<const char*>(bytes->data()), bytes->length);
+            flushIfFull();
+            return true;
+        }
+        case ObjType::INSTANCE:
+        {
+            if (writeObjectRef(asObject(value))) return true;
+
+            ObjInstance* instance = asInstance(value);
+            size_t fieldCount = 0;
+            instance->fields.forEach([&](ObjString*, const Value&) { ++fieldCount; });
+
+            writeTag(Tag::INSTANCE);
+            writeString(instance->klass->name);
+            writeVarint(fieldCount);
+
+            bool written = true;
+            instance->fields.forEach([&](ObjString* name, const Value& field)
+            {
+                if (!written) return;
+                writeString(name);
+                written = writeValue(field, depth + 1);
+                flushIfFull();
+            });
+            return written;
+        }
+        default:
+            // Functions, classes, iterators, files...
+            writeTag(Tag::NIL);
+            return true;
+        }
+    }
+
+    bool flush()
+    {
+        if (file == nullptr) return true;
+
+        const bool written = file->write(out.data(), out.size());
+        out.clear();
+        return written;
+    }
+
+    void flushIfFull()
+    {
+        if (file != nullptr && out.size() >= SERIALIZE_BUFFER_SIZE)
+        {
+            failed = !flush() || failed;
+        }
+    }
+
+    std::string& out;
+    FileWriter* file;
+    bool failed = false;
+
+    // The views point into strings that are reachable from the value being written, so they stay alive
+    std::unordered_map<std::string_view, uint32_t> strings;
+    std::unordered_map<const Obj*, uint32_t> objects;
+};
+
+bool serializeValue(const Value& value, std::string& out)
+{
+    Serializer serializer(out, nullptr);
+    return serializer.write(value);
+}
+
+bool serializeValue(const Value& value, FileWriter& file)
+{
+    if (!file.isOpen()) return false;
+
+    std::string buffer;
+    Serializer serializer(buffer, &file);
+    return serializer.write(value);
+}
+
+// Every string and object read is kept in a list on the VM stack, they are both the tables the
+// references point into and what keeps them from being collected while the value is incomplete.
+class Deserializer
+{
+public:
+
+    Deserializer(std::string_view bytes, ObjList* strings, ObjList* objects)
+        : current(bytes.data())
+        , end(bytes.data() + bytes.length())
+        , strings(strings)
+        , objects(objects)
+    {}
+
+    bool read(Value* result)
+    {
+        if (remaining() < SERIALIZE_MAGIC_LENGTH + 1) return false;
+        if (memcmp(current, SERIALIZE_MAGIC, SERIALIZE_MAGIC_LENGTH) != 0) return false;
+        current += SERIALIZE_MAGIC_LENGTH;
+
+        uint8_t version;
+        if (!readByte(version) || version != SERIALIZE_VERSION) return false;
+
+        // Nothing can follow the value
+        return readValue(result, 0) && current == end;
+    }
+
+private:
+
+    size_t remaining() const { return end - current; }
+
+    bool readByte(uint8_t& byte)
+    {
+        if (current == end) return false;
+        byte = static_cast<uint8_t>(*current++);
+        return true;
+    }
+
+    bool readVarint(uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            uint8_t byte;
+            if (!readByte(byte)) return false;
+
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) return true;
+        }
+        return false;
+    }
+
+    // Counts are checked against the bytes left, so a corrupt count can't reserve huge amounts of memory
+    bool readCount(size_t& count, size_t minimumSize)
+    {
+        uint64_t value;
+        if (!readVarint(value) || value > remaining() / minimumSize) return false;
+        count = static_cast<size_t>(value);
+        return true;
+    }
+
+    bool readDouble(double& value)
+    {
+        if (remaining() < 8) return false;
+
+        uint64_t bits = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            bits |= static_cast<uint64_t>(static_cast<uint8_t>(current[i])) << (i * 8);
+        }
+        current += 8;
+        memcpy(&value, &bits, sizeof(value));
+        return true;
+    }
+
+    bool readString(Tag tag, ObjString** result)
+    {
+        if (tag == Tag::STRING_REF)
+        {
+            uint64_t index;
+            if (!readVarint(index) || index >= strings->items.size()) return false;
+            *result = asString(strings->items[index]);
+            return true;
+        }
+
+        size_t length;
+        if (tag != Tag::STRING || !readCount(length, 1) || length > INT_MAX) return false;
+
+        *result = takeString(current, static_cast<int>(length));
+        current += length;
+        strings->append(Value(*result));
+        return true;
+    }
+
+    bool readStringValue(ObjString** result)
+    {
+        uint8_t tag;
+        return readByte(tag) && readString(static_cast<Tag>(tag), result);
+    }
+
+    bool readValue(Value* result, int depth)
+    {
+        if (depth > SERIALIZE_MAX_DEPTH) return false;
+
+        uint8_t byte;
+        if (!readByte(byte) || byte >= static_cast<uint8_t>(Tag::COUNT)) return false;
+
+        const Tag tag = static_cast<Tag>(byte);
+        switch (tag)
+        {
+        case Tag::NIL: *result = Value(); return true;
+        case Tag::BOOL_FALSE: *result = Value(false); return true;
+        case Tag::BOOL_TRUE: *result = Value(true); return true;
+        case Tag::INTEGER:
+        {
+            uint64_t zigzag;
+            if (!readVarint(zigzag)) return false;
+            const int64_t integer = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+            *result = Value(static_cast<double>(integer));
+            return true;
+        }
+        case Tag::NUMBER:
+        {
+            double number;
+            if (!readDouble(number)) return false;
+            *result = Value(number);
+            return true;
+        }
+        case Tag::STRING:
+        case Tag::STRING_REF:
+        {
+            ObjString* string;
+            if (!readString(tag, &string)) return false;
+            *result = Value(string);
+            return true;
+        }
+        case Tag::OBJECT_REF:
+        {
+            uint64_t index;
+            if (!readVarint(index) || index >= objects->items.size()) return false;
+            *result = objects->items[index];
+            return true;
+        }
+        case Tag::LIST:
+        {
+            // Registered before the elements are read, so they can refer to it
+            ObjList* list = newList();
+            objects->append(Value(list));
+
+            size_t count;
+            if (!readCount(count, 1)) return false;
+            list->items.reserve(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                Value element;
+                if (!readValue(&element, depth + 1)) return false;
+                list->append(element);
+            }
+            *result = Value(list);
+            return true;
+        }
+        case Tag::MAP:
+        case Tag::SET:
+        {
+            const bool isMapValue = tag == Tag::MAP;
+            Obj* object = isMapValue ? static_cast<Obj*>(newMap()) : static_cast<Obj*>(newSet());
+            objects->append(Value(object));
+            ValueTable& table = isMapValue ? static_cast<ObjMap*>(object)->table : static_cast<ObjSet*>(object)->table;
+
+            size_t count;
+            if (!readCount(count, isMapValue ? 2 : 1)) return false;
+            for (size_t i = 0; i < count; ++i)
+            {
+                // Keys are strings or objects, which are kept in the tables, or don't need to be kept at all
+                Value key;
+                Value element;
+                if (!readValue(&key, depth + 1)) return false;
+                if (isMapValue && !readValue(&element, depth + 1)) return false;
+                table.set(tableKey(key), element);
+            }
+            *result = Value(object);
+            return true;
+        }
+        case Tag::FLOAT_ARRAY:
+        {
+            ObjFloatArray* array = newFloatArray();
+            objects->append(Value(array));
+
+            size_t count;
+            if (!readCount(count, 8)) return false;
+            array->items.resize(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                readDouble(array->items[i]);
+            }
+            *result = Value(array);
+            return true;
+        }
+        case Tag::BYTES:
+        {
+            ObjBytes* bytes = newBytes(0);
+            objects->append(Value(bytes));
+
+            size_t length;
+            if (!readCount(length, 1)) return false;
+            bytes->storage.assign(current, current + length);
+            bytes->length = length;
+            current += length;
+            *result = Value(bytes);
+            return true;
+        }
+        case Tag::INSTANCE:
+        {
+            ObjString* className;
+            if (!readStringValue(&className)) return false;
+
+            Value klass;
+            if (!VM::getInstance().globalTable().get(internString(className), &klass) || !isClass(klass))
+                return false;
+
+            ObjInstance* instance = newInstance(asClass(klass));
+            objects->append(Value(instance));
+
+            size_t count;
+            if (!readCount(count, 2)) return false;
+            for (size_t i = 0; i < count; ++i)
+            {
+                ObjString* name;
+                Value field;
+                if (!readStringValue(&name) || !readValue(&field, depth + 1)) return false;
+                instance->fields.set(internString(name), field);
+            }
+            *result = Value(instance);
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    const char* current;
+    const char* end;
+    ObjList* strings;
+    ObjList* objects;
+};
+
+bool deserializeValue(std::string_view bytes, Value* result)
+{
+    VM* vm = &VM::getInstance();
+
+    ObjList* strings = newList();
+    vm->push(Value(strings));
+    ObjList* objects = newList();
+    vm->push(Value(objects));
+
+    Deserializer deserializer(bytes, strings, objects);
+    const bool valid = deserializer.read(result);
+
+    vm->pop();
+    vm->pop();
+    return valid;
+}
@@ -0,0 +1,25 @@
+#ifndef loxcpp_serialize_h
+#define loxcpp_serialize_h
+
+#include <string>
+#include <string_view>
+
+#include "Value.h"
+
+class FileWriter;
+
+// Compact binary encoding of values, to pass them between processes or save them.
+// Equal strings are written once and referenced afterwards. Objects reachable more than once are
+// written once too, so shared references and cycles are restored as they were.
+// Instances are written with the name of their class and their fields, and they get the class with
+// that name when they are read. Functions, iterators and other values that can't be encoded are written as nil.
+// Returns false if the value nests too deep.
+bool serializeValue(const Value& value, std::string& out);
+
+// Same encoding, written to a file as it's produced so the encoding is never in memory as a whole
+bool serializeValue(const Value& value, FileWriter& file);
+
+// Returns false if the bytes aren't a valid encoding, or an instance's class doesn't exist
+bool deserializeValue(std::string_view bytes, Value* result);
+
+#endif
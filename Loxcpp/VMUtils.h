@@ -1,6 +1,10 @@
 #ifndef loxcpp_vmutils_h
 #define loxcpp_vmutils_h
 
+#include <climits>
+#include <cmath>
+#include <cstdint>
+
 #include "Vm.h"
 
 inline bool isFalsey(const Value& value)
@@ -13,9 +17,220 @@ inline bool isCallable(const Value& value)
     return isClosure(value) || isBoundMethod(value);
 }
 
+// Index from a number, truncated like a cast. Numbers that can't be an index become -1, which is out of bounds.
+// Ranges can have more elements than an int can count.
+inline int64_t rangeIndex(double number)
+{
+    return number > -1.0 && number < 9.2e18 ? static_cast<int64_t>(number) : -1;
+}
+
+// Lists, strings and the other containers never have more than INT_MAX elements
+inline int containerIndex(double number)
+{
+    return number > -1.0 && number < INT_MAX + 1.0 ? static_cast<int>(number) : -1;
+}
+
+// Size of a new container, or -1 when it isn't a whole number from 0 to INT_MAX
+inline int containerSize(double number)
+{
+    return number >= 0.0 && number <= INT_MAX && number == std::floor(number) ? static_cast<int>(number) : -1;
+}
+
 inline bool isIterable(const Value& value)
 {
-    return isList(value) || isString(value) || isRange(value);
+    return isList(value) || isString(value) || isRange(value) || isIterator(value) || isMap(value) || isSet(value) || isFloatArray(value) || isBytes(value);
+}
+
+inline int pushArgs(VM* vm) { return 0; }
+
+template<typename FirstArg, typename... Args>
+inline int pushArgs(VM* vm, const FirstArg& firstValue, const Args&... values)
+{
+    vm->push(firstValue);
+    return pushArgs(vm, values...) + 1;
+}
+
+template<typename... Args>
+inline Value callFunction(VM* vm, const Value& callable, const Args&... values)
+{
+    vm->push(callable);
+    const int argCount = pushArgs(vm, values...);
+    vm->callValue(callable, argCount);
+    vm->run(vm->getFrameCount() - 1);
+    return vm->pop();
+}
+
+bool iteratorNext(ObjIterator* iterator, Value* next);
+
+// Pulls the next element of an iterable, cursor is only used when the iterable is not an iterator
+inline bool pullIterable(const Value& iterable, int64_t& cursor, Value* next)
+{
+    if (isIterator(iterable))
+    {
+        return iteratorNext(asIterator(iterable), next);
+    }
+    else if (isRange(iterable))
+    {
+        ObjRange* range = asRange(iterable);
+        if (!range->isInBounds(cursor)) return false;
+        *next = Value(range->getValue(cursor++));
+        return true;
+    }
+    else if (isList(iterable))
+    {
+        // The cursor never goes past the end of a container, so it fits in an int
+        ObjList* list = asList(iterable);
+        if (!list->isInBounds(static_cast<int>(cursor))) return false;
+        *next = list->getValue(static_cast<int>(cursor++));
+        return true;
+    }
+    else if (isFloatArray(iterable))
+    {
+        ObjFloatArray* array = asFloatArray(iterable);
+        if (!array->isInBounds(static_cast<int>(cursor))) return false;
+        *next = Value(array->getValue(static_cast<int>(cursor++)));
+        return true;
+    }
+    else if (isBytes(iterable))
+    {
+        ObjBytes* bytes = asBytes(iterable);
+        if (!bytes->isInBounds(static_cast<int>(cursor))) return false;
+        *next = Value(static_cast<double>(bytes->data()[cursor++]));
+        return true;
+    }
+    else if (isString(iterable))
+    {
+        ObjString* str = asString(iterable);
+        if (cursor < 0 || cursor >= str->length) return false;
+        *next = Value(VM::getInstance().characterString(str->chars()[cursor++]));
+        return true;
+    }
+    else if (isMap(iterable) || isSet(iterable))
+    {
+        const ValueTable& table = isMap(iterable) ? asMap(iterable)->table : asSet(iterable)->table;
+        if (cursor < 0 || static_cast<size_t>(cursor) >= table.count()) return false;
+        *next = table.entryAt(static_cast<size_t>(cursor++)).key;
+        return true;
+    }
+
+    return false;
+}
+
+inline bool iteratorNext(ObjIterator* iterator, Value* next)
+{
+    if (iterator->exhausted) return false;
+
+    VM* vm = &VM::getInstance();
+    Value element;
+    bool found = false;
+
+    switch (iterator->kind)
+    {
+    case IteratorKind::MAP:
+    {
+        if (pullIterable(iterator->source, iterator->sourceIndex, &element))
+        {
+            iterator->current = callFunction(vm, iterator->argument, element);
+            found = true;
+        }
+        break;
+    }
+    case IteratorKind::FILTER:
+    {
+        while (pullIterable(iterator->source, iterator->sourceIndex, &element))
+        {
+            // Keep the element in the iterator while the predicate runs, so it's not collected
+            iterator->current = element;
+            if (!isFalsey(callFunction(vm, iterator->argument, element)))
+            {
+                found = true;
+                break;
+            }
+        }
+        break;
+    }
+    case IteratorKind::TAKE:
+    {
+        if (iterator->index < asNumber(iterator->argument) &&
+            pullIterable(iterator->source, iterator->sourceIndex, &element))
+        {
+            iterator->current = element;
+            found = true;
+        }
+        break;
+    }
+    case IteratorKind::ZIP:
+    {
+        Value other;
+        if (pullIterable(iterator->source, iterator->sourceIndex, &element))
+        {
+            vm->push(element);
+            if (pullIterable(iterator->argument, iterator->argumentIndex, &other))
+            {
+                vm->push(other);
+                ObjList* pair = newList();
+                pair->append(element);
+                pair->append(other);
+                iterator->current = Value(pair);
+                vm->pop();
+                found = true;
+            }
+            vm->pop();
+        }
+        break;
+    }
+    case IteratorKind::LINES:
+    {
+        std::string_view line;
+        if (iterator->reader->next(line))
+        {
+            iterator->current = Value(takeString(line.data(), static_cast<int>(line.length())));
+            found = true;
+        }
+        break;
+    }
+    case IteratorKind::JSON_EVENTS:
+    {
+        JsonEvent event;
+        if (iterator->jsonReader->next(event))
+        {
+            iterator->current = jsonEventToValue(event);
+            found = true;
+        }
+        break;
+    }
+    case IteratorKind::CSV_ROWS:
+    {
+        std::vector<CsvField> fields;
+        if (iterator->csvReader->next(fields))
+        {
+            ObjList* row = newList();
+            iterator->current = Value(row);
+
+            std::string scratch;
+            for (const CsvField& field : fields)
+            {
+                row->append(Value(csvFieldString(field, scratch)));
+            }
+            found = true;
+        }
+        break;
+    }
+    }
+
+    if (!found)
+    {
+        iterator->exhausted = true;
+        iterator->current = Value();
+        iterator->reader.reset();
+        iterator->jsonReader.reset();
+        iterator->csvReader.reset();
+        return false;
+    }
+
+    iterator->index++;
+    *next = iterator->current;
+    return true;
 }
 
 template<typename F>
@@ -24,7 +239,7 @@ inline void forEachIterable(const Value& iterable, F predicate)
     if (isRange(iterable))
     {
         ObjRange* range = asRange(iterable);
-        for (int idx = 0; range->isInBounds(idx); ++idx)
+        for (int64_t idx = 0; range->isInBounds(idx); ++idx)
         {
             const Value element(range->getValue(idx));
             if (!predicate(element, idx))
@@ -44,32 +259,64 @@ inline void forEachIterable(const Value& iterable, F predicate)
     else if (isString(iterable))
     {
         ObjString* str = asString(iterable);
-        for (int idx = 0; idx < str->chars.size(); ++idx)
+        for (int idx = 0; idx < str->length; ++idx)
+        {
+            const Value element(VM::getInstance().characterString(str->chars()[idx]));
+            if (!predicate(element, idx))
+                return;
+        }
+    }
+    else if (isMap(iterable))
+    {
+        // Iterating a map visits its keys
+        ObjMap* map = asMap(iterable);
+        for (size_t idx = 0; idx < map->table.count(); ++idx)
+        {
+            const Value element(map->table.entryAt(idx).key);
+            if (!predicate(element, static_cast<int64_t>(idx)))
+                return;
+        }
+    }
+    else if (isFloatArray(iterable))
+    {
+        ObjFloatArray* array = asFloatArray(iterable);
+        for (int idx = 0; array->isInBounds(idx); ++idx)
+        {
+            const Value element(array->getValue(idx));
+            if (!predicate(element, idx))
+                return;
+        }
+    }
+    else if (isBytes(iterable))
+    {
+        ObjBytes* bytes = asBytes(iterable);
+        for (int idx = 0; bytes->isInBounds(idx); ++idx)
+        {
+            const Value element(static_cast<double>(bytes->data()[idx]));
+            if (!predicate(element, idx))
+                return;
+        }
+    }
+    else if (isSet(iterable))
+    {
+        ObjSet* set = asSet(iterable);
+        for (size_t idx = 0; idx < set->table.count(); ++idx)
+        {
+            const Value element(set->table.entryAt(idx).key);
+            if (!predicate(element, static_cast<int64_t>(idx)))
+                return;
+        }
+    }
+    else if (isIterator(iterable))
+    {
+        ObjIterator* iterator = asIterator(iterable);
+        Value element;
+        for (int idx = 0; iteratorNext(iterator, &element); ++idx)
         {
-            const Value element(takeString(&str->chars[idx], 1));
             if (!predicate(element, idx))
                 return;
         }
     }
-}
-
-inline int pushArgs(VM* vm) { return 0; }
-
-template<typename FirstArg, typename... Args>
-inline int pushArgs(VM* vm, const FirstArg& firstValue, const Args&... values)
-{
-    vm->push(firstValue);
-    return pushArgs(vm, values...) + 1;
-}
-
-template<typename... Args>
-inline Value callFunction(VM* vm, const Value& callable, const Args&... values)
-{
-    vm->push(callable);
-    const int argCount = pushArgs(vm, values...);
-    vm->callValue(callable, argCount);
-    vm->run(vm->getFrameCount() - 1);
-    return vm->pop();
 }
 
 #endif
@@ -1,33 +1,91 @@
 #include "Value.h"
 
 #include <iostream>
+#include <cstring>
+#include <charconv>
+#include <cmath>
 
 #include "Object.h"
 
-void printValue(const Value& value)
+uint32_t hashBits(uint64_t bits)
+{
+    // Murmur3 finalizer, spreads the bits so they can be masked to a power of two capacity
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+    bits *= 0xc4ceb9fe1a85ec53ULL;
+    bits ^= bits >> 33;
+    return static_cast<uint32_t>(bits);
+}
+
+uint32_t hashValue(const Value& value)
 {
     switch (value.type)
     {
-    case ValueType::BOOL:
-        std::cout << (asBoolean(value) ? "true" : "false");
-        break;
-    case ValueType::NIL: std::cout << "nil"; break;
-    case ValueType::NUMBER: std::cout << asNumber(value); break;
-    case ValueType::OBJ: printObject(value); break;
+    case ValueType::BOOL: return asBoolean(value) ? 3 : 5;
+    case ValueType::NIL: return 7;
+    case ValueType::NUMBER:
+    {
+        // 0 and -0 are equal, so they need the same hash
+        const double number = asNumber(value) == 0 ? 0.0 : asNumber(value);
+        uint64_t bits;
+        memcpy(&bits, &number, sizeof(bits));
+        return hashBits(bits);
+    }
+    case ValueType::OBJ:
+    {
+        if (isString(value)) return stringHash(asString(value));
+        return hashBits(reinterpret_cast<uintptr_t>(asObject(value)));
     }
+    }
+    return 0;
+}
+
+void printValue(const Value& value)
+{
+    std::string text;
+    appendValue(text, value);
+    std::cout << text;
 }
 
 ObjString* valueAsString(const Value& value)
 {
-    switch (value.type)
+    // Strings are already their own text
+    if (isString(value)) return asString(value);
+
+    std::string text;
+    appendValue(text, value);
+    return takeString(std::move(text));
+}
+
+int formatNumber(double number, char* buffer)
+{
+    // Whole numbers are written as integers, the shortest form of 100000 would be 1e+05
+    if (number == std::trunc(number) && std::fabs(number) < 1e15)
     {
-    case ValueType::BOOL: return (asBoolean(value) ? takeString("true", 4) : takeString("false", 5));
-    case ValueType::NIL: return takeString("nil", 3);
-    case ValueType::NUMBER: return takeString(std::to_string(asNumber(value)));
-    case ValueType::OBJ: objectAsString(value); break;
+        const std::to_chars_result result = std::to_chars(buffer, buffer + 32, static_cast<long long>(number));
+        return static_cast<int>(result.ptr - buffer);
     }
 
-    return takeString("<Unknown>", 9);
+    const std::to_chars_result result = std::to_chars(buffer, buffer + 32, number);
+    return static_cast<int>(result.ptr - buffer);
+}
+
+void appendNumber(std::string& out, double number)
+{
+    char buffer[32];
+    out.append(buffer, formatNumber(number, buffer));
+}
+
+void appendValue(std::string& out, const Value& value)
+{
+    switch (value.type)
+    {
+    case ValueType::BOOL: out += asBoolean(value) ? "true" : "false"; break;
+    case ValueType::NIL: out += "nil"; break;
+    case ValueType::NUMBER: appendNumber(out, asNumber(value)); break;
+    case ValueType::OBJ: printObject(out, value); break;
+    }
 }
 
 size_t sizeOf(const Value& value)
@@ -54,7 +112,17 @@ bool Value::operator==(const Value& other) const
         case ValueType::NUMBER: return asNumber(*this) == asNumber(other);
         case ValueType::OBJ:
         {
-            return asObject(*this) == asObject(other);
+            if (asObject(*this) == asObject(other)) return true;
+
+            // Interned strings are equal only if they are the same object, ropes have to compare their characters
+            if (isString(*this) && isString(other))
+            {
+                ObjString* a = asString(*this);
+                ObjString* b = asString(other);
+                if (a->isInterned() && b->isInterned()) return false;
+                return a->length == b->length && memcmp(a->chars(), b->chars(), a->length) == 0;
+            }
+            return false;
         }
         default:                return false; // Unreachable.
     }
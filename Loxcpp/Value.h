@@ -81,8 +81,16 @@ struct ValueArray
     std::vector<Value> values;
 };
 
+uint32_t hashValue(const Value& value);
 void printValue(const Value& value);
+// Text of the value as a string, the same print shows
 ObjString* valueAsString(const Value& value);
+
+// Shortest text that reads back as the same number. Returns its length, buffer needs room for 32 characters.
+int formatNumber(double number, char* buffer);
+void appendNumber(std::string& out, double number);
+// Same text print shows for the value
+void appendValue(std::string& out, const Value& value);
 size_t sizeOf(const Value& value);
 
 #endif
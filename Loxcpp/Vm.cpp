@@ -5,10 +5,12 @@
 #include <sstream>
 #include <cstdarg>
 #include <cmath>
+#include <algorithm>
 #include <time.h>
 
 #include "Debug.h"
 #include "Natives.h"
+#include "Profiler.h"
 #include "VMUtils.h"
 
 constexpr int GC_HEAP_GROW_FACTOR = 2;
@@ -19,6 +21,7 @@ VM::VM()
     , frameCount(0)
     , openUpvalues(nullptr)
     , compiler()
+    , flushPolicy(isTerminal(stdout) ? FlushPolicy::LINE : FlushPolicy::FULL)
 {
     resetStack();
 }
@@ -28,6 +31,7 @@ InterpretResult VM::interpret(const std::string& source)
     if (!nativesDefined)
     {
         nativesDefined = true;
+        initCharacterStrings();
         registerNatives(this);
 
         // TODO: Add support for static functions and properties
@@ -75,12 +79,19 @@ InterpretResult VM::interpret(const std::string& source)
     push(Value(closure));
     call(closure, 0);
 
-    return run(0);
+    const InterpretResult result = run(0);
+    flushOutput();
+    return result;
 }
 
 void VM::addObject(Obj* obj)
 {
     bytesAllocated += sizeof(*obj);
+    if (callProfiler != nullptr)
+    {
+        callProfiler->countAllocation();
+    }
+
     if (bytesAllocated > nextGC)
     {
         collectGarbage();
@@ -130,6 +141,16 @@ void VM::collectGarbage()
 #endif
 }
 
+void VM::initCharacterStrings()
+{
+    // They are roots, so the ones created so far survive a collection triggered by the next one
+    for (int i = 0; i < 256; ++i)
+    {
+        const char c = static_cast<char>(i);
+        characterStrings[i] = copyString(&c, 1);
+    }
+}
+
 void VM::markRoots()
 {
     for (Value* slot = &stack[0]; slot < stackTop; slot++)
@@ -150,6 +171,12 @@ void VM::markRoots()
     }
 
     globals.mark();
+
+    for (ObjString* character : characterStrings)
+    {
+        markObject(character);
+    }
+
     markCompilerRoots();
 }
 
@@ -176,6 +203,18 @@ void VM::sweep()
         }
         else
         {
+#ifdef DEBUG_OPCODE_STATS
+            if (object->type == ObjType::FUNCTION)
+            {
+                opcodeStats.forget(static_cast<ObjFunction*>(object));
+            }
+#endif
+
+            if (callProfiler != nullptr && (object->type == ObjType::FUNCTION || object->type == ObjType::NATIVE))
+            {
+                callProfiler->forget(object);
+            }
+
             bytesAllocated -= sizeof(*object);
             delete object;
             it = objects.erase(it);
@@ -232,9 +271,26 @@ void VM::blackenObject(Obj* object)
 
     switch (object->type) {
     case ObjType::NATIVE:
-    case ObjType::STRING:
     case ObjType::RANGE:
+    case ObjType::FLOAT_ARRAY:
+    case ObjType::STRING_BUILDER:
+    case ObjType::FILE:
         break;
+    case ObjType::STRING:
+    {
+        ObjString* string = static_cast<ObjString*>(object);
+        if (string->kind == StringKind::ROPE)
+        {
+            ObjRope* rope = static_cast<ObjRope*>(object);
+            markObject(rope->left);
+            markObject(rope->right);
+        }
+        else if (string->kind == StringKind::SLICE)
+        {
+            markObject(static_cast<ObjSlice*>(object)->parent);
+        }
+        break;
+    }
     case ObjType::LIST:
     {
         ObjList* list = static_cast<ObjList*>(object);
@@ -244,6 +300,23 @@ void VM::blackenObject(Obj* object)
         }
         break;
     }
+    case ObjType::ITERATOR:
+    {
+        ObjIterator* iterator = static_cast<ObjIterator*>(object);
+        markValue(iterator->source);
+        markValue(iterator->argument);
+        markValue(iterator->current);
+        break;
+    }
+    case ObjType::MAP:
+        static_cast<ObjMap*>(object)->table.mark();
+        break;
+    case ObjType::SET:
+        static_cast<ObjSet*>(object)->table.mark();
+        break;
+    case ObjType::BYTES:
+        markObject(static_cast<ObjBytes*>(object)->parent);
+        break;
     case ObjType::UPVALUE:
         markValue((static_cast<ObjUpvalue*>(object)->closed));
         break;
@@ -289,10 +362,17 @@ void VM::blackenObject(Obj* object)
     }
     }
 
-    static_assert(static_cast<int>(ObjType::COUNT) == 10, "Missing enum value");
+    static_assert(static_cast<int>(ObjType::COUNT) == 17, "Missing enum value");
 }
 
 InterpretResult VM::run(int depth)
+{
+    // The loop is compiled twice so the check for samples costs nothing when not profiling
+    return profiler != nullptr ? runLoop<true>(depth) : runLoop<false>(depth);
+}
+
+template<bool SAMPLING>
+InterpretResult VM::runLoop(int depth)
 {
     CallFrame* frame = &frames[frameCount - 1];
 
@@ -330,6 +410,17 @@ InterpretResult VM::run(int depth)
             static_cast<size_t>(frame->ip - &frame->closure->function->chunk.code[0]));
 #endif
 
+        if constexpr (SAMPLING)
+        {
+            if (profiler->isSampleDue())
+                profiler->sample(frames.data(), frameCount);
+        }
+
+#ifdef DEBUG_OPCODE_STATS
+        opcodeStats.record(static_cast<OpCode>(*frame->ip), frame->closure->function,
+            static_cast<size_t>(frame->ip - &frame->closure->function->chunk.code[0]));
+#endif
+
         const OpCode instruction = static_cast<OpCode>(readByte());
         switch (instruction )
         {
@@ -379,7 +470,7 @@ InterpretResult VM::run(int depth)
                 Value value;
                 if (!globals.get(name, &value))
                 {
-                    runtimeError("Undefined variable '%s'.", name->chars.c_str());
+                    runtimeError("Undefined variable '%s'.", name->chars());
                     return InterpretResult::INTERPRET_RUNTIME_ERROR;
                 }
                 push(value);
@@ -410,7 +501,7 @@ InterpretResult VM::run(int depth)
                 if (globals.set(name, peek(0)))
                 {
                     globals.remove(name);
-                    runtimeError("Undefined variable '%s'.", name->chars.c_str());
+                    runtimeError("Undefined variable '%s'.", name->chars());
                     return InterpretResult::INTERPRET_RUNTIME_ERROR;
                 }
                 break;
@@ -421,7 +512,7 @@ InterpretResult VM::run(int depth)
                 Value value;
                 if (!globals.get(name, &value))
                 {
-                    runtimeError("Undefined variable '%s'.", name->chars.c_str());
+                    runtimeError("Undefined variable '%s'.", name->chars());
                     return InterpretResult::INTERPRET_RUNTIME_ERROR;
                 }
                 push(value);
@@ -440,7 +531,7 @@ InterpretResult VM::run(int depth)
                 if (globals.set(name, peek(0)))
                 {
                     globals.remove(name);
-                    runtimeError("Undefined variable '%s'.", name->chars.c_str());
+                    runtimeError("Undefined variable '%s'.", name->chars());
                     return InterpretResult::INTERPRET_RUNTIME_ERROR;
                 }
                 break;
@@ -712,6 +803,25 @@ InterpretResult VM::run(int depth)
                 push(Value(newRange(min, max)));
                 break;
             }
+            case OpCode::OP_BUILD_RANGE_STEP:
+            {
+                // stack is: [...,min,max,step] and after: [range]
+                if (!isNumber(peek(0)) || !isNumber(peek(1)) || !isNumber(peek(2)))
+                {
+                    runtimeError("Range bounds must be numbers.");
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                const double step = asNumber(pop());
+                const double max = asNumber(pop());
+                const double min = asNumber(pop());
+                if (step == 0)
+                {
+                    runtimeError("Range step can't be zero.");
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                push(Value(newRange(min, max, step)));
+                break;
+            }
             case OpCode::OP_BUILD_LIST:
             {
                 // Stack before: [item1, item2, ..., itemN] and after: [list]
@@ -735,6 +845,30 @@ InterpretResult VM::run(int depth)
                 push(Value(list));
                 break;
             }
+            case OpCode::OP_BUILD_MAP:
+            {
+                // Stack before: [key1, value1, ..., keyN, valueN] and after: [map]
+                ObjMap* map = newMap();
+                uint8_t entryCount = readByte();
+
+                push(Value(map)); // So map isn't sweeped by GC while adding entries
+                for (int i = entryCount * 2; i > 0; i -= 2)
+                {
+                    map->table.set(tableKey(peek(i)), peek(i - 1));
+                }
+                pop();
+
+                stackTop -= entryCount * 2;
+
+                push(Value(map));
+                break;
+            }
+            case OpCode::OP_BUILD_STRING:
+            {
+                // Stack before: [part1, ..., partN] and after: [string]
+                buildString(readByte());
+                break;
+            }
             case OpCode::OP_INDEX_SUBSCR:
             {
                 // stack is: [...,source,index] and after: [item]
@@ -749,8 +883,14 @@ InterpretResult VM::run(int depth)
                         return InterpretResult::INTERPRET_RUNTIME_ERROR;
                     }
 
+                    // Fields are looked up by identity, so ropes have to be interned.
+                    // That can allocate, the operands are kept on the stack meanwhile.
+                    push(source);
+                    push(index);
+                    ObjString* name = internString(asString(index));
+                    stackTop -= 2;
+
                     ObjInstance* instance = asInstance(source);
-                    ObjString* name = asString(index);
 
                     Value value;
                     if (instance->fields.get(name, &value))
@@ -768,13 +908,63 @@ InterpretResult VM::run(int depth)
                     push(Value()); // Nil
                     break;
                 }
+                if (isMap(source))
+                {
+                    Value value;
+                    asMap(source)->table.get(index, &value);
+                    push(value);
+                    break;
+                }
+                if (isString(source) && isRange(index))
+                {
+                    // Slice, both ends are included like when iterating the range: "hello"[1..3] is "ell"
+                    ObjString* string = asString(source);
+                    ObjRange* range = asRange(index);
+                    if (range->step != 1.0)
+                    {
+                        runtimeError("String slices can't have a step.");
+                        return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                    }
+
+                    const double first = std::isfinite(range->min) ? std::max(range->min, 0.0) : 0.0;
+                    const double last = std::isfinite(range->max) ? std::min(range->max, string->length - 1.0) : string->length - 1.0;
+                    const int start = static_cast<int>(std::min(first, static_cast<double>(string->length)));
+                    const int length = std::max(static_cast<int>(last) - start + 1, 0);
+
+                    push(source); // Rooted while the slice is allocated
+                    ObjString* slice = sliceString(string, start, length);
+                    peek(0) = Value(slice);
+                    break;
+                }
+                if (isBytes(source) && isRange(index))
+                {
+                    // View of the same bytes, with both ends included like string slices
+                    ObjBytes* bytes = asBytes(source);
+                    ObjRange* range = asRange(index);
+                    if (range->step != 1.0)
+                    {
+                        runtimeError("Byte slices can't have a step.");
+                        return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                    }
+
+                    const double size = static_cast<double>(bytes->length);
+                    const double first = std::isfinite(range->min) ? std::max(range->min, 0.0) : 0.0;
+                    const double last = std::isfinite(range->max) ? std::min(range->max, size - 1.0) : size - 1.0;
+                    const double start = std::min(first, size);
+                    const double length = std::max(std::floor(last) - start + 1.0, 0.0);
+
+                    push(source); // Rooted while the view is allocated
+                    ObjBytes* view = sliceBytes(bytes, static_cast<size_t>(start), static_cast<size_t>(length));
+                    peek(0) = Value(view);
+                    break;
+                }
                 if (!isNumber(index))
                 {
                     runtimeError("Index is not a number.");
                     return InterpretResult::INTERPRET_RUNTIME_ERROR;
                 }
 
-                const int idx = static_cast<int>(asNumber(index));
+                const int idx = containerIndex(asNumber(index));
 
                 if (isList(source))
                 {
@@ -788,12 +978,25 @@ InterpretResult VM::run(int depth)
                         push(Value());
                     }
                 }
+                else if (isFloatArray(source))
+                {
+                    ObjFloatArray* array = asFloatArray(source);
+                    if (array->isInBounds(idx))
+                    {
+                        push(Value(array->getValue(idx)));
+                    }
+                    else
+                    {
+                        push(Value());
+                    }
+                }
                 else if (isRange(source))
                 {
                     ObjRange* range = asRange(source);
-                    if (range->isInBounds(idx))
+                    const int64_t rangeIdx = rangeIndex(asNumber(index));
+                    if (range->isInBounds(rangeIdx))
                     {
-                        push(Value(range->getValue(idx)));
+                        push(Value(range->getValue(rangeIdx)));
                     }
                     else
                     {
@@ -805,9 +1008,19 @@ InterpretResult VM::run(int depth)
                     ObjString* string = asString(source);
                     if (idx >= 0 && idx < string->length)
                     {
-                        const char c = string->chars[idx];
-                        ObjString* character = takeString(&c, 1);
-                        push(Value(character));
+                        push(Value(characterString(string->chars()[idx])));
+                    }
+                    else
+                    {
+                        push(Value());
+                    }
+                }
+                else if (isBytes(source))
+                {
+                    ObjBytes* bytes = asBytes(source);
+                    if (bytes->isInBounds(idx))
+                    {
+                        push(Value(static_cast<double>(bytes->data()[idx])));
                     }
                     else
                     {
@@ -837,12 +1050,29 @@ InterpretResult VM::run(int depth)
                         return InterpretResult::INTERPRET_RUNTIME_ERROR;
                     }
 
+                    // Fields are looked up by identity, so ropes have to be interned.
+                    // That can allocate, the operands are kept on the stack meanwhile.
+                    push(source);
+                    push(index);
+                    push(item);
+                    ObjString* name = internString(asString(index));
+                    stackTop -= 3;
+
                     ObjInstance* instance = asInstance(source);
-                    ObjString* name = asString(index);
 
                     instance->fields.set(name, item);
                     push(item);
                 }
+                else if (isMap(source))
+                {
+                    push(source);
+                    push(item);
+                    const Value key = tableKey(index);
+                    stackTop -= 2;
+
+                    asMap(source)->table.set(key, item);
+                    push(item);
+                }
                 else
                 {
                     if (!isNumber(index))
@@ -851,7 +1081,7 @@ InterpretResult VM::run(int depth)
                         return InterpretResult::INTERPRET_RUNTIME_ERROR;
                     }
 
-                    const int idx = static_cast<int>(asNumber(index));
+                    const int idx = containerIndex(asNumber(index));
 
                     if (isList(source))
                     {
@@ -867,6 +1097,44 @@ InterpretResult VM::run(int depth)
                         list->setValue(idx, item);
                         push(item);
                     }
+                    else if (isFloatArray(source))
+                    {
+                        ObjFloatArray* array = asFloatArray(source);
+
+                        if (!array->isInBounds(idx))
+                        {
+                            runtimeError("Invalid list index.");
+                            return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                        }
+
+                        if (!isNumber(item))
+                        {
+                            runtimeError("Float arrays can only store numbers.");
+                            return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                        }
+
+                        array->setValue(idx, asNumber(item));
+                        push(item);
+                    }
+                    else if (isBytes(source))
+                    {
+                        ObjBytes* bytes = asBytes(source);
+
+                        if (!bytes->isInBounds(idx))
+                        {
+                            runtimeError("Invalid bytes index.");
+                            return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                        }
+
+                        if (!isNumber(item) || asNumber(item) < 0.0 || asNumber(item) > 255.0 || std::trunc(asNumber(item)) != asNumber(item))
+                        {
+                            runtimeError("Bytes can only store whole numbers from 0 to 255.");
+                            return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                        }
+
+                        bytes->data()[idx] = static_cast<uint8_t>(asNumber(item));
+                        push(item);
+                    }
                     else if (isString(source))
                     {
                         if(!isString(item))
@@ -878,7 +1146,13 @@ InterpretResult VM::run(int depth)
                         ObjString* str = asString(source);
                         ObjString* character = asString(item);
 
-                        if (character->chars.length() != 1)
+                        if (str->kind == StringKind::SLICE || str->kind == StringKind::MAPPED)
+                        {
+                            runtimeError("Can't modify a string slice or a mapped file.");
+                            return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                        }
+
+                        if (character->length != 1)
                         {
                             runtimeError("Invalid string length.");
                             return InterpretResult::INTERPRET_RUNTIME_ERROR;
@@ -886,7 +1160,8 @@ InterpretResult VM::run(int depth)
 
                         if (idx >= 0 && idx < str->length)
                         {
-                            str->chars[idx] = character->chars[0];
+                            str->chars()[idx] = character->chars()[0];
+                            if (!str->isInterned()) str->hash = 0; // Computed again when needed
                         }
                         else
                         {
@@ -911,25 +1186,98 @@ InterpretResult VM::run(int depth)
                     return InterpretResult::INTERPRET_RUNTIME_ERROR;
                 }
 
-                const int idx = static_cast<int>(asNumber(pop()));
+                // Loops over ranges can count past INT_MAX, the other containers can't
+                const double index = asNumber(pop());
+                const int idx = containerIndex(index);
                 const Value item = pop();
 
                 if (isRange(item))
                 {
                     ObjRange* range = asRange(item);
-                    push(Value(range->isInBounds(idx)));
+                    push(Value(range->isInBounds(rangeIndex(index))));
                 }
                 else if (isList(item))
                 {
                     ObjList* list = asList(item);
                     push(Value(list->isInBounds(idx)));
                 }
+                else if (isMap(item))
+                {
+                    push(Value(idx >= 0 && static_cast<size_t>(idx) < asMap(item)->table.count()));
+                }
+                else if (isSet(item))
+                {
+                    push(Value(idx >= 0 && static_cast<size_t>(idx) < asSet(item)->table.count()));
+                }
+                else if (isFloatArray(item))
+                {
+                    push(Value(asFloatArray(item)->isInBounds(idx)));
+                }
+                else if (isBytes(item))
+                {
+                    push(Value(asBytes(item)->isInBounds(idx)));
+                }
                 else if (isString(item))
                 {
                     ObjString* string = asString(item);
                     const bool isInRange = idx >= 0 && idx < string->length;
                     push(Value(isInRange));
                 }
+                else if (isIterator(item))
+                {
+                    // Iterators are sequential, each bounds check pulls the next element
+                    Value element;
+                    push(Value(iteratorNext(asIterator(item), &element)));
+                }
+                else
+                {
+                    runtimeError("Invalid range type.");
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            }
+            case OpCode::OP_RANGE_VALUE:
+            {
+                // Value visited by a for-in loop, the index was already checked by OP_RANGE_IN_BOUNDS
+                // stack is: [...,source,index] and after: [item]
+                const double index = asNumber(pop());
+                const int idx = containerIndex(index);
+                const Value source = pop();
+
+                if (isRange(source))
+                {
+                    push(Value(asRange(source)->getValue(rangeIndex(index))));
+                }
+                else if (isList(source))
+                {
+                    push(asList(source)->getValue(idx));
+                }
+                else if (isFloatArray(source))
+                {
+                    push(Value(asFloatArray(source)->getValue(idx)));
+                }
+                else if (isString(source))
+                {
+                    push(Value(characterString(asString(source)->chars()[idx])));
+                }
+                else if (isBytes(source))
+                {
+                    push(Value(static_cast<double>(asBytes(source)->data()[idx])));
+                }
+                else if (isMap(source))
+                {
+                    // Iterating a map visits its keys
+                    push(asMap(source)->table.entryAt(idx).key);
+                }
+                else if (isSet(source))
+                {
+                    push(asSet(source)->table.entryAt(idx).key);
+                }
+                else if (isIterator(source))
+                {
+                    // Iterators are sequential, the bounds check already pulled the element
+                    push(asIterator(source)->current);
+                }
                 else
                 {
                     runtimeError("Invalid range type.");
@@ -937,6 +1285,35 @@ InterpretResult VM::run(int depth)
                 }
                 break;
             }
+            case OpCode::OP_RANGE_SETUP:
+            {
+                // Range literals iterated by a for-in loop don't allocate an ObjRange.
+                // stack is: [...,start,end,step] and after: [...,start,signedStep,count]
+                if (!isNumber(peek(0)) || !isNumber(peek(1)) || !isNumber(peek(2)))
+                {
+                    runtimeError("Range bounds must be numbers.");
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+
+                const double step = std::fabs(asNumber(pop()));
+                const double end = asNumber(pop());
+                const double start = asNumber(peek(0));
+
+                if (!std::isfinite(start))
+                {
+                    runtimeError("Can't iterate a range without a start.");
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+                if (step == 0)
+                {
+                    runtimeError("Range step can't be zero.");
+                    return InterpretResult::INTERPRET_RUNTIME_ERROR;
+                }
+
+                push(Value(start <= end ? step : -step));
+                push(Value(ObjRange::elementCount(start, end, step)));
+                break;
+            }
             case OpCode::OP_NOT:
             {
                 push(Value(isFalsey(pop())));
@@ -950,8 +1327,7 @@ InterpretResult VM::run(int depth)
                     push(str);
                 }
 
-                printValue(pop());
-                printf("\n");
+                print(pop());
                 break;
             }
             case OpCode::OP_JUMP:
@@ -1050,6 +1426,11 @@ InterpretResult VM::run(int depth)
                 break;
             case OpCode::OP_RETURN:
             {
+                if (callProfiler != nullptr)
+                {
+                    callProfiler->exit();
+                }
+
                 const Value result = pop();
                 closeUpvalues(frame->slots);
                 frameCount--;
@@ -1082,7 +1463,7 @@ InterpretResult VM::run(int depth)
                 defineMethod(readStringLong());
                 break;
         }
-        static_assert(static_cast<int>(OpCode::COUNT) == 54, "Missing operations in the VM");
+        static_assert(static_cast<int>(OpCode::COUNT) == 59, "Missing operations in the VM");
     }
 }
 
@@ -1094,6 +1475,9 @@ void VM::resetStack()
 
 inline void VM::runtimeError(const char* format, ...) 
 {
+    // Keep what was printed before the error in order with it
+    flushOutput();
+
     va_list args;
     va_start(args, format);
     vfprintf(stderr, format, args);
@@ -1113,10 +1497,15 @@ inline void VM::runtimeError(const char* format, ...)
         }
         else
         {
-            std::cerr << function->name->chars << "()" << std::endl;
+            std::cerr << function->name->chars() << "()" << std::endl;
         }
     }
 
+    if (callProfiler != nullptr)
+    {
+        callProfiler->unwind();
+    }
+
     resetStack();
 }
 
@@ -1177,6 +1566,34 @@ void VM::concatenate()
     push(Value(concat));
 }
 
+void VM::buildString(uint8_t partCount)
+{
+    // Instances with a toString method format themselves
+    for (int i = partCount - 1; i >= 0; --i)
+    {
+        if (isInstance(peek(i)))
+        {
+            const Value str = instanceToString(peek(i));
+            if (isString(str))
+                peek(i) = str;
+        }
+    }
+
+    // Every part is formatted into the same buffer, so only the result is allocated.
+    // The parts stay on the stack until then, in case it triggers a collection.
+    static std::string buffer;
+    buffer.clear();
+    for (int i = partCount - 1; i >= 0; --i)
+    {
+        appendValue(buffer, peek(i));
+    }
+
+    ObjString* result = takeString(buffer.c_str(), static_cast<int>(buffer.length()));
+
+    stackTop -= partCount;
+    push(Value(result));
+}
+
 void VM::push(Value value)
 {
     *stackTop = value;
@@ -1211,6 +1628,11 @@ bool VM::call(ObjClosure* closure, uint8_t argCount)
     frame->closure = closure;
     frame->ip = &closure->function->chunk.code[0];
     frame->slots = stackTop - argCount - 1;
+
+    if (callProfiler != nullptr)
+    {
+        callProfiler->enter(closure->function);
+    }
     return true;
 }
 
@@ -1254,8 +1676,18 @@ bool VM::callValue(const Value& callee, uint8_t argCount)
                 return false;
             }
 
+            if (callProfiler != nullptr)
+            {
+                callProfiler->enter(native);
+            }
+
             const Value result = native->function(argCount, stackTop - (native->isMethod ? argCount + 1 : argCount), this);
             stackTop -= argCount + 1;
+
+            if (callProfiler != nullptr)
+            {
+                callProfiler->exit();
+            }
             push(result);
             return true;
         }
@@ -1272,7 +1704,7 @@ bool VM::invokeFromClass(ObjClass* klass, ObjString* name, uint8_t argCount)
     Value method;
     if (!klass->methods.get(name, &method))
     {
-        runtimeError("Undefined property '%s'.", name->chars.c_str());
+        runtimeError("Undefined property '%s'.", name->chars());
         return false;
     }
     return callValue(method, argCount);
@@ -1362,7 +1794,7 @@ void VM::defineMethod(ObjString* name)
 {
     const Value method = peek(0);
     ObjClass* klass = asClass(peek(1));
-    if (name->length == 4 && name->chars == "init")
+    if (name->length == 4 && name->view() == "init")
     {
         klass->initializer = method;
     }
@@ -1394,3 +1826,27 @@ Value VM::instanceToString(Value& instanceVal)
 
     return Value();
 }
+
+// Lets a script that prints a lot write it in few system calls
+constexpr size_t OUTPUT_BUFFER_SIZE = 64 * 1024;
+
+void VM::print(const Value& value)
+{
+    appendValue(output, value);
+    output += '\n';
+
+    if (flushPolicy == FlushPolicy::LINE || (flushPolicy == FlushPolicy::FULL && output.size() >= OUTPUT_BUFFER_SIZE))
+    {
+        flushOutput();
+    }
+}
+
+void VM::flushOutput()
+{
+    if (!output.empty())
+    {
+        fwrite(output.data(), 1, output.size(), stdout);
+        output.clear();
+    }
+    fflush(stdout);
+}
@@ -11,8 +11,11 @@
 #include "HashTable.h"
 #include "Object.h"
 #include "Compiler.h"
+#include "OpcodeStats.h"
 
 class Compiler;
+class SamplingProfiler;
+class CallProfiler;
 
 enum class InterpretResult 
 {
@@ -30,6 +33,14 @@ struct CallFrame
     Value* slots = nullptr;
 };
 
+// When the output printed by the script is written to stdout
+enum class FlushPolicy
+{
+    LINE,    // After every print, so output shows up as soon as it's printed
+    FULL,    // When the buffer is full
+    EXPLICIT // Only when flushOutput is called, or the script ends
+};
+
 struct NativeMethodDef
 {
     const char* name;
@@ -49,6 +60,10 @@ public:
 
     ~VM()
     {
+        flushOutput();
+#ifdef DEBUG_OPCODE_STATS
+        opcodeStats.report(std::cerr);
+#endif
         freeAllObjects();
     }
 
@@ -61,6 +76,10 @@ public:
     InterpretResult interpret(const std::string& source);
 
     Table& stringTable() { return strings; }
+    Table& globalTable() { return globals; }
+
+    // Preallocated strings for every single byte, so indexing or iterating a string doesn't look up the intern table
+    ObjString* characterString(char c) const { return characterStrings[static_cast<uint8_t>(c)]; }
 
     // Memory. TODO: Separate from the VM
     void addObject(Obj* obj);
@@ -88,12 +107,28 @@ public:
     void defineNative(const char* name, uint8_t arity, NativeFn function);
     void defineNativeClass(const char* name, std::vector<NativeMethodDef>&& methods);;
 
+    // Output printed by the script
+    void setFlushPolicy(FlushPolicy policy) { flushPolicy = policy; }
+    void flushOutput();
+
+    // Samples the call stack while the profiler is set, nullptr turns it off
+    void setProfiler(SamplingProfiler* sampler) { profiler = sampler; }
+
+    // Counts the calls and allocations of every function while the profiler is set
+    void setCallProfiler(CallProfiler* calls) { callProfiler = calls; }
+    CallProfiler* getCallProfiler() const { return callProfiler; }
+
 private:
 
+    template<bool SAMPLING>
+    InterpretResult runLoop(int depth);
+
     void resetStack();
+    void initCharacterStrings();
     void runtimeError(const char* format, ...);
     bool validateBinaryOperator();
     void concatenate();
+    void buildString(uint8_t partCount);
 
     bool call(ObjClosure* closure, uint8_t argCount);
     bool invokeFromClass(ObjClass* klass, ObjString* name, uint8_t argCount);
@@ -104,6 +139,7 @@ private:
     void defineMethod(ObjString* name);
 
     Value instanceToString(Value& instanceVal);
+    void print(const Value& value);
 
     static constexpr size_t STACK_MAX = 256;
     static constexpr size_t FRAMES_MAX = 255;
@@ -116,9 +152,20 @@ private:
     Value* stackTop;
     Table strings;
     Table globals;
+    std::array<ObjString*, 256> characterStrings = {};
     Compiler compiler;
     bool nativesDefined = false;
 
+    std::string output;
+    FlushPolicy flushPolicy;
+
+    SamplingProfiler* profiler = nullptr;
+    CallProfiler* callProfiler = nullptr;
+
+#ifdef DEBUG_OPCODE_STATS
+    OpcodeStats opcodeStats;
+#endif
+
     std::vector<Obj*> grayNodes;
     size_t bytesAllocated = 0;
     size_t nextGC = 256;